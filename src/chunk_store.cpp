@@ -0,0 +1,183 @@
+#include "chunk_store.h"
+
+#include <chrono>
+#include <cstring>
+
+#include "file_data.h"
+#include "slab_allocator.h"
+
+static constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+static uint64_t rotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t load64(const char* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint64_t hash_round(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME2;
+	return rotl(acc, 31) * PRIME1;
+}
+
+static uint64_t merge_round(uint64_t acc, uint64_t value)
+{
+	acc ^= hash_round(0, value);
+	return acc * PRIME1 + PRIME4;
+}
+
+uint64_t hash_chunk(const char* data, size_t size)
+{
+	const char* p = data;
+	const char* end = data + size;
+	uint64_t h;
+	if (size >= 32) {
+		// 四路独立累加, 数据块大小是 32 的倍数, 全部走这个循环
+		uint64_t v1 = PRIME1 + PRIME2;
+		uint64_t v2 = PRIME2;
+		uint64_t v3 = 0;
+		uint64_t v4 = 0 - PRIME1;
+		for (; p + 32 <= end; p += 32) {
+			v1 = hash_round(v1, load64(p));
+			v2 = hash_round(v2, load64(p + 8));
+			v3 = hash_round(v3, load64(p + 16));
+			v4 = hash_round(v4, load64(p + 24));
+		}
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = merge_round(h, v1);
+		h = merge_round(h, v2);
+		h = merge_round(h, v3);
+		h = merge_round(h, v4);
+	} else {
+		h = PRIME5;
+	}
+	h += size;
+	for (; p + 8 <= end; p += 8) {
+		h ^= hash_round(0, load64(p));
+		h = rotl(h, 27) * PRIME1 + PRIME4;
+	}
+	for (; p < end; p++) {
+		h ^= static_cast<uint8_t>(*p) * PRIME5;
+		h = rotl(h, 11) * PRIME1;
+	}
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+ChunkStore& ChunkStore::instance()
+{
+	static ChunkStore store;
+	return store;
+}
+
+ChunkStore::Shard& ChunkStore::shard_of(uint64_t hash)
+{
+	// 分片用高位, unordered_map 的桶用低位
+	return shards_[(hash >> 58) % SHARD_COUNT];
+}
+
+SharedChunk* ChunkStore::intern(char* chunk)
+{
+	auto start = std::chrono::steady_clock::now();
+	uint64_t hash = hash_chunk(chunk, FileData::CHUNK_SIZE);
+	hashed_.fetch_add(1, std::memory_order_relaxed);
+	hash_ns_.fetch_add(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+		std::memory_order_relaxed);
+	Shard& shard = shard_of(hash);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto it = shard.chunks.find(hash);
+	if (it != shard.chunks.end()) {
+		SharedChunk* shared = it->second;
+		if (memcmp(shared->data, chunk, FileData::CHUNK_SIZE) != 0) {
+			return nullptr;
+		}
+		shared->refs++;
+		refs_.fetch_add(1, std::memory_order_relaxed);
+		return shared;
+	}
+	SharedChunk* shared = static_cast<SharedChunk*>(slab_alloc(sizeof(SharedChunk)));
+	shared->hash = hash;
+	shared->refs = 1;
+	shared->indexed = true;
+	shared->data = chunk;
+	shard.chunks.emplace(hash, shared);
+	refs_.fetch_add(1, std::memory_order_relaxed);
+	chunks_.fetch_add(1, std::memory_order_relaxed);
+	return shared;
+}
+
+SharedChunk* ChunkStore::share(char* chunk)
+{
+	SharedChunk* shared = static_cast<SharedChunk*>(slab_alloc(sizeof(SharedChunk)));
+	// 用地址散列出分片
+	shared->hash = reinterpret_cast<uintptr_t>(shared) * PRIME1;
+	shared->refs = 1;
+	shared->indexed = false;
+	shared->data = chunk;
+	refs_.fetch_add(1, std::memory_order_relaxed);
+	chunks_.fetch_add(1, std::memory_order_relaxed);
+	return shared;
+}
+
+void ChunkStore::ref(SharedChunk* shared)
+{
+	Shard& shard = shard_of(shared->hash);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	shared->refs++;
+	refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ChunkStore::erase_locked(Shard& shard, SharedChunk* shared)
+{
+	if (shared->indexed) {
+		shard.chunks.erase(shared->hash);
+	}
+	slab_free(shared, sizeof(SharedChunk));
+	chunks_.fetch_sub(1, std::memory_order_relaxed);
+	refs_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+size_t ChunkStore::release(SharedChunk* shared)
+{
+	Shard& shard = shard_of(shared->hash);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	if (--shared->refs > 0) {
+		refs_.fetch_sub(1, std::memory_order_relaxed);
+		return 0;
+	}
+	slab_free(shared->data, FileData::CHUNK_SIZE);
+	erase_locked(shard, shared);
+	return FileData::CHUNK_SIZE;
+}
+
+char* ChunkStore::take(SharedChunk* shared)
+{
+	Shard& shard = shard_of(shared->hash);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	if (shared->refs > 1) {
+		return nullptr;
+	}
+	char* data = shared->data;
+	erase_locked(shard, shared);
+	return data;
+}
+
+ChunkStore::Stats ChunkStore::stats()
+{
+	return {chunks_.load(), refs_.load(), hashed_.load(), hash_ns_.load()};
+}
@@ -0,0 +1,68 @@
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// 是否对文件数据块做去重
+struct DedupConfig {
+	bool enabled = false;
+};
+
+// 多个文件共享的数据块, refs 由所在分片的锁保护
+// indexed 表示按内容登记在表中(去重); 克隆产生的共享块不登记, hash 只用来选分片
+struct SharedChunk {
+	uint64_t hash;
+	uint32_t refs;
+	bool indexed;
+	char* data;
+};
+
+// 按内容寻址的数据块表: 内容哈希 -> 共享块, 内容相同的 64KiB 块在所有文件间只存一份
+// 哈希相同时再逐字节比较, 内容不同(哈希冲突)的块不共享; 表按哈希分片, 每片一把锁
+// 共享块只读, FileData 写入前拷贝成私有块(只剩一个引用时直接摘下接管)
+// 克隆(copy_file_range, MEMFS_IOC_CLONE_RANGE)也用共享块, 不计算哈希
+class ChunkStore
+{
+  public:
+	static constexpr size_t SHARD_COUNT = 64;
+	struct Stats {
+		uint64_t chunks;
+		uint64_t refs;
+		uint64_t hashed;
+		uint64_t hash_ns;
+	};
+	static ChunkStore& instance();
+	// 登记内容为 chunk(CHUNK_SIZE 字节, slab 分配)的块: 已有相同内容时增加引用并返回已有的块, 调用者释放 chunk;
+	// 否则接管 chunk 作为新的共享块; 哈希冲突时返回 nullptr, 块保持私有
+	SharedChunk* intern(char* chunk);
+	// 接管私有块 chunk 作为一个引用的共享块, 不计算哈希也不登记到表中
+	SharedChunk* share(char* chunk);
+	void ref(SharedChunk* shared);
+	// 减少引用, 返回最后一个引用释放的字节数(0 或 CHUNK_SIZE)
+	size_t release(SharedChunk* shared);
+	// 只剩一个引用时从表中摘除并交出数据块, 否则返回 nullptr
+	char* take(SharedChunk* shared);
+	Stats stats();
+
+  private:
+	struct Shard {
+		std::mutex mutex;
+		std::unordered_map<uint64_t, SharedChunk*> chunks;
+	};
+	ChunkStore() = default;
+	Shard& shard_of(uint64_t hash);
+	void erase_locked(Shard& shard, SharedChunk* shared);
+	std::array<Shard, SHARD_COUNT> shards_;
+	std::atomic<uint64_t> chunks_{0};
+	std::atomic<uint64_t> refs_{0};
+	std::atomic<uint64_t> hashed_{0};
+	std::atomic<uint64_t> hash_ns_{0};
+};
+
+// 64 位内容哈希(xxHash64 的算法), 只用于找候选块, 共享前还要比较内容
+uint64_t hash_chunk(const char* data, size_t size);
+#endif
@@ -0,0 +1,132 @@
+#include "compressor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "mem_fs.h"
+
+// 当前线程消耗的 CPU 时间, 不含等锁的时间
+static uint64_t thread_cpu_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+Compressor::~Compressor()
+{
+	stop();
+}
+
+int Compressor::start(const CompressConfig& config)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (running_ || config.after == 0) {
+		return 0;
+	}
+	after_ = config.after;
+	running_ = true;
+	thread_ = std::thread(&Compressor::compress_loop, this);
+	return 0;
+}
+
+int Compressor::stop()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!running_) {
+		return 0;
+	}
+	running_ = false;
+	lock.unlock();
+	cond_.notify_all();
+	thread_.join();
+	return 0;
+}
+
+void Compressor::compress_loop()
+{
+	// 文件最晚在变冷后半个周期内被压缩
+	auto interval = std::chrono::seconds(std::max<uint32_t>(1, after_ / 2));
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (running_) {
+		cond_.wait_for(lock, interval, [this] { return !running_; });
+		if (!running_) {
+			break;
+		}
+		lock.unlock();
+		scan();
+		lock.lock();
+	}
+}
+
+void Compressor::scan()
+{
+	time_t now = time(nullptr);
+	std::vector<MemoryFilePtr> cold_files;
+	inodes.for_each([this, now, &cold_files](const MemoryFilePtr& file) {
+		if (file->load_state == LoadState::LOADED && !file->need_flush && !file->compress_done
+			&& difftime(now, file->last_access) >= after_) {
+			cold_files.push_back(file);
+		}
+	});
+	for (const auto& file : cold_files) {
+		if (!running_) {
+			return;
+		}
+		compress_file(file);
+	}
+}
+
+void Compressor::compress_file(const MemoryFilePtr& file)
+{
+	time_t seen = file->last_access;
+	uint64_t raw = 0;
+	uint64_t compressed = 0;
+	uint64_t start = thread_cpu_ns();
+	uint64_t index = 0;
+	while (index != FileData::NO_DATA && running_) {
+		std::unique_lock<std::shared_mutex> lock(file->rw_mutex);
+		if (file->load_state != LoadState::LOADED || file->need_flush || file->last_access != seen) {
+			break;
+		}
+		index = file->data.compress_chunks(index, BATCH_CHUNKS, raw, compressed);
+		if (index == FileData::NO_DATA) {
+			file->compress_done = true;
+		}
+	}
+	uint64_t cpu = thread_cpu_ns() - start;
+	cpu_ns_ += cpu;
+	if (raw == 0) {
+		return;
+	}
+	files_++;
+	raw_bytes_ += raw;
+	compressed_bytes_ += compressed;
+	LOGD("compressed %s: %lu -> %lu bytes (ratio %.2f), %.3f ms cpu\n",
+		 get_path_by_file(file).c_str(),
+		 raw,
+		 compressed,
+		 static_cast<double>(raw) / compressed,
+		 cpu / 1e6);
+}
+
+void Compressor::log_stats(LogLevel level)
+{
+	uint64_t raw = raw_bytes_.load();
+	uint64_t compressed = compressed_bytes_.load();
+	log_message(level,
+				__FILE__,
+				__LINE__,
+				__func__,
+				"compression: %lu chunks compressed now, %lu file passes, %lu -> %lu bytes (ratio %.2f) in %.3f s cpu, "
+				"%lu decompressions in %.3f s\n",
+				FileData::total_compressed(),
+				files_.load(),
+				raw,
+				compressed,
+				compressed == 0 ? 0.0 : static_cast<double>(raw) / compressed,
+				cpu_ns_.load() / 1e9,
+				FileData::decompressions(),
+				FileData::decompress_ns() / 1e9);
+}
@@ -0,0 +1,57 @@
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+#include "log_utils.h"
+#include "mem_fs_file.h"
+
+// 文件多少秒没有读写后压缩其数据块, 0 表示不压缩
+struct CompressConfig {
+	uint32_t after = 0;
+};
+
+// 冷数据压缩: 后台线程定期找出超过 after 秒没有打开, 读写或截断的已加载干净文件, 用内置 LZ 压缩其私有数据块
+// 每次持文件写锁压缩 BATCH_CHUNKS 块, 期间文件被访问或变脏就停下, 等它再次变冷
+// 读写到压缩块时在文件写锁下解压(FileData), 所以压缩后的文件下次访问会多一次解压的开销
+// 每个文件的压缩比和 CPU 时间记在调试日志中, stat 的 st_blocks 按压缩后的大小计
+class Compressor
+{
+  public:
+	static constexpr size_t BATCH_CHUNKS = 16;
+	~Compressor();
+	int start(const CompressConfig& config);
+	int stop();
+	void log_stats(LogLevel level);
+
+  private:
+	void compress_loop();
+	void scan();
+	void compress_file(const MemoryFilePtr& file);
+	std::atomic<bool> running_{false};
+	uint32_t after_ = 0;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::thread thread_;
+	std::atomic<uint64_t> files_{0};
+	std::atomic<uint64_t> raw_bytes_{0};
+	std::atomic<uint64_t> compressed_bytes_{0};
+	std::atomic<uint64_t> cpu_ns_{0};
+};
+
+// 记录文件被访问, 供压缩线程判断冷热; 同一秒内只写一次
+inline void touch_file(const MemoryFilePtr& file)
+{
+	time_t now = time(nullptr);
+	if (file->last_access.load(std::memory_order_relaxed) != now) {
+		file->last_access.store(now, std::memory_order_relaxed);
+	}
+	if (file->compress_done.load(std::memory_order_relaxed)) {
+		file->compress_done.store(false, std::memory_order_relaxed);
+	}
+}
+#endif
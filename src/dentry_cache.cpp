@@ -0,0 +1,83 @@
+#include "dentry_cache.h"
+
+#include <mutex>
+
+DentryCache::Shard& DentryCache::shard_of(const Key& key)
+{
+	return shards_[(KeyHash()(key) >> 7) % SHARD_COUNT];
+}
+
+bool DentryCache::lookup(uint64_t parent, const std::string& name, uint64_t& ino)
+{
+	Key key{parent, name};
+	Shard& shard = shard_of(key);
+	std::shared_lock<std::shared_mutex> lock(shard.mutex);
+	auto it = shard.entries.find(key);
+	if (it == shard.entries.end()) {
+		shard.misses.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	ino = it->second;
+	shard.hits.fetch_add(1, std::memory_order_relaxed);
+	if (ino == NEGATIVE) {
+		shard.negative_hits.fetch_add(1, std::memory_order_relaxed);
+	}
+	return true;
+}
+
+void DentryCache::insert(uint64_t parent, const std::string& name, uint64_t ino)
+{
+	Key key{parent, name};
+	Shard& shard = shard_of(key);
+	std::unique_lock<std::shared_mutex> lock(shard.mutex);
+	if (shard.entries.size() >= SHARD_CAPACITY && shard.entries.find(key) == shard.entries.end()) {
+		// 满了就随便淘汰一项, 缓存只影响性能不影响正确性
+		shard.entries.erase(shard.entries.begin());
+	}
+	shard.entries[std::move(key)] = ino;
+}
+
+void DentryCache::invalidate(uint64_t parent, const std::string& name)
+{
+	Key key{parent, name};
+	Shard& shard = shard_of(key);
+	std::unique_lock<std::shared_mutex> lock(shard.mutex);
+	shard.entries.erase(key);
+}
+
+uint64_t DentryCache::hits()
+{
+	uint64_t total = 0;
+	for (auto& shard : shards_) {
+		total += shard.hits.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+uint64_t DentryCache::negative_hits()
+{
+	uint64_t total = 0;
+	for (auto& shard : shards_) {
+		total += shard.negative_hits.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+uint64_t DentryCache::misses()
+{
+	uint64_t total = 0;
+	for (auto& shard : shards_) {
+		total += shard.misses.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+size_t DentryCache::size()
+{
+	size_t total = 0;
+	for (auto& shard : shards_) {
+		std::shared_lock<std::shared_mutex> lock(shard.mutex);
+		total += shard.entries.size();
+	}
+	return total;
+}
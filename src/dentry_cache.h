@@ -0,0 +1,51 @@
+#ifndef DENTRY_CACHE_H
+#define DENTRY_CACHE_H
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+// (父目录 inode, 文件名) -> 子 inode 的查找缓存, ino 为 NEGATIVE 时表示该名字不存在
+// 填充和失效都必须在持有父目录 rw_mutex 时进行(填充持读锁, 失效持写锁), 否则可能缓存过期结果
+class DentryCache
+{
+  public:
+	static constexpr uint64_t NEGATIVE = 0;
+	static constexpr size_t SHARD_COUNT = 64;
+	static constexpr size_t SHARD_CAPACITY = 16384;
+	bool lookup(uint64_t parent, const std::string& name, uint64_t& ino);
+	void insert(uint64_t parent, const std::string& name, uint64_t ino);
+	void invalidate(uint64_t parent, const std::string& name);
+	uint64_t hits();
+	uint64_t negative_hits();
+	uint64_t misses();
+	size_t size();
+
+  private:
+	struct Key {
+		uint64_t parent;
+		std::string name;
+		bool operator==(const Key& other) const
+		{
+			return parent == other.parent && name == other.name;
+		}
+	};
+	struct KeyHash {
+		size_t operator()(const Key& key) const
+		{
+			return std::hash<std::string>()(key.name) ^ (key.parent * 0x9E3779B97F4A7C15ULL);
+		}
+	};
+	struct alignas(64) Shard {
+		std::shared_mutex mutex;
+		std::unordered_map<Key, uint64_t, KeyHash> entries;
+		std::atomic<uint64_t> hits{0};
+		std::atomic<uint64_t> negative_hits{0};
+		std::atomic<uint64_t> misses{0};
+	};
+	Shard& shard_of(const Key& key);
+	std::array<Shard, SHARD_COUNT> shards_;
+};
+#endif
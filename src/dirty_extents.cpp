@@ -0,0 +1,116 @@
+#include "dirty_extents.h"
+
+#include <algorithm>
+
+std::atomic<uint64_t> DirtyExtents::total_bytes_{0};
+
+DirtyExtents::~DirtyExtents()
+{
+	total_bytes_.fetch_sub(dirty_bytes_, std::memory_order_relaxed);
+}
+
+void DirtyExtents::account(uint64_t before)
+{
+	// 无符号回绕后相加等价于加上有符号的差值
+	total_bytes_.fetch_add(dirty_bytes_ - before, std::memory_order_relaxed);
+}
+
+void DirtyExtents::add(uint64_t start, uint64_t end)
+{
+	if (start >= end) {
+		return;
+	}
+	uint64_t before = dirty_bytes_;
+	// 找到第一个可能与 [start, end) 重叠或相邻的区间: 起点不大于 start 的最后一个区间
+	auto it = extents_.upper_bound(start);
+	if (it != extents_.begin()) {
+		auto prev = std::prev(it);
+		if (prev->second >= start) {
+			it = prev;
+		}
+	}
+	while (it != extents_.end() && it->first <= end) {
+		start = std::min(start, it->first);
+		end = std::max(end, it->second);
+		dirty_bytes_ -= it->second - it->first;
+		it = extents_.erase(it);
+	}
+	extents_.emplace_hint(it, start, end);
+	dirty_bytes_ += end - start;
+	account(before);
+}
+
+void DirtyExtents::truncate(uint64_t size)
+{
+	uint64_t before = dirty_bytes_;
+	auto it = extents_.lower_bound(size);
+	while (it != extents_.end()) {
+		dirty_bytes_ -= it->second - it->first;
+		it = extents_.erase(it);
+	}
+	if (!extents_.empty()) {
+		auto last = std::prev(extents_.end());
+		if (last->second > size) {
+			dirty_bytes_ -= last->second - size;
+			last->second = size;
+		}
+	}
+	account(before);
+}
+
+void DirtyExtents::clear()
+{
+	extents_.clear();
+	total_bytes_.fetch_sub(dirty_bytes_, std::memory_order_relaxed);
+	dirty_bytes_ = 0;
+}
+
+void DirtyExtents::take(uint64_t max_bytes, std::vector<std::pair<uint64_t, uint64_t>>& out)
+{
+	uint64_t before = dirty_bytes_;
+	auto it = extents_.begin();
+	while (it != extents_.end() && max_bytes > 0) {
+		uint64_t len = it->second - it->first;
+		if (len > max_bytes) {
+			// 拆分: 前半部分取走, 后半部分以新起点留下
+			uint64_t split = it->first + max_bytes;
+			out.emplace_back(it->first, split);
+			extents_.emplace_hint(std::next(it), split, it->second);
+			dirty_bytes_ -= max_bytes;
+			extents_.erase(it);
+			break;
+		}
+		out.emplace_back(it->first, it->second);
+		dirty_bytes_ -= len;
+		max_bytes -= len;
+		it = extents_.erase(it);
+	}
+	account(before);
+}
+
+bool DirtyExtents::empty() const
+{
+	return extents_.empty();
+}
+
+size_t DirtyExtents::count() const
+{
+	return extents_.size();
+}
+
+uint64_t DirtyExtents::dirty_bytes() const
+{
+	return dirty_bytes_;
+}
+
+uint64_t DirtyExtents::total_bytes()
+{
+	return total_bytes_.load(std::memory_order_relaxed);
+}
+
+void DirtyExtents::for_each(const std::function<void(uint64_t start, uint64_t end)>& func) const
+{
+	for (const auto& extent : extents_) {
+		func(extent.first, extent.second);
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef DIRTY_EXTENTS_H
+#define DIRTY_EXTENTS_H
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "slab_allocator.h"
+
+// 文件中待回写的区间集合, 按起点排序, 区间之间互不重叠也不相邻(写入时与重叠或相邻的区间合并)
+// 同一范围反复写入只占一个区间, 回写成功后清空. 不加锁, 由所属 MemoryFile 的 rw_mutex 保护
+class DirtyExtents
+{
+  public:
+	DirtyExtents() = default;
+	~DirtyExtents();
+	DirtyExtents(const DirtyExtents&) = delete;
+	DirtyExtents& operator=(const DirtyExtents&) = delete;
+	// 标记 [start, end) 为脏
+	void add(uint64_t start, uint64_t end);
+	// 文件截断到 size 后丢弃 size 之后的部分
+	void truncate(uint64_t size);
+	void clear();
+	// 从最前面取出总长不超过 max_bytes 的区间放入 out 并从集合中删除, 必要时拆分区间
+	void take(uint64_t max_bytes, std::vector<std::pair<uint64_t, uint64_t>>& out);
+	bool empty() const;
+	size_t count() const;
+	uint64_t dirty_bytes() const;
+	// 所有文件的脏字节数之和, 用于回写阈值和写入限流
+	static uint64_t total_bytes();
+	// 按起点顺序遍历每个区间 [start, end)
+	void for_each(const std::function<void(uint64_t start, uint64_t end)>& func) const;
+
+  private:
+	using Map = std::map<uint64_t,
+						 uint64_t,
+						 std::less<uint64_t>,
+						 SlabStlAllocator<std::pair<const uint64_t, uint64_t>>>;
+	// 起点 -> 终点
+	// 把 dirty_bytes_ 相对 before 的变化计入 total_bytes_
+	void account(uint64_t before);
+	Map extents_;
+	uint64_t dirty_bytes_ = 0;
+	static std::atomic<uint64_t> total_bytes_;
+};
+#endif
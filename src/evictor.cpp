@@ -0,0 +1,159 @@
+#include "evictor.h"
+
+#include <chrono>
+
+#include "mem_fs.h"
+
+Evictor::~Evictor()
+{
+	stop();
+}
+
+int Evictor::start(const EvictConfig& config)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (running_ || config.max_bytes == 0 || real_path_perfix.empty()) {
+		// 没有 target 时内容无处重新加载, 不淘汰
+		return 0;
+	}
+	max_bytes_ = config.max_bytes;
+	running_ = true;
+	thread_ = std::thread(&Evictor::evict_loop, this);
+	return 0;
+}
+
+int Evictor::stop()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!running_) {
+		return 0;
+	}
+	running_ = false;
+	lock.unlock();
+	cond_.notify_all();
+	thread_.join();
+	return 0;
+}
+
+void Evictor::track(const MemoryFilePtr& file, bool hit)
+{
+	(hit ? hits_ : misses_)++;
+	if (!running_ || file->in_clock.exchange(true)) {
+		return;
+	}
+	std::unique_lock<std::mutex> lock(mutex_);
+	added_.push_back(file->ino);
+}
+
+void Evictor::kick()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	kicked_ = true;
+	cond_.notify_one();
+}
+
+void Evictor::record_reload()
+{
+	reloads_++;
+}
+
+void Evictor::evict_loop()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (running_) {
+		// 写回完成的文件不会唤醒本线程, 所以也定期检查
+		cond_.wait_for(lock, std::chrono::seconds(1), [this] { return !running_ || kicked_; });
+		if (!running_) {
+			break;
+		}
+		clock_.insert(clock_.end(), added_.begin(), added_.end());
+		added_.clear();
+		lock.unlock();
+		if (FileData::total_bytes() > max_bytes_) {
+			sweep();
+		}
+		lock.lock();
+		// 全是脏文件或打开的文件时淘汰不动, 限制被唤醒的频率
+		cond_.wait_for(lock, std::chrono::milliseconds(10), [this] { return !running_; });
+		kicked_ = false;
+	}
+}
+
+void Evictor::sweep()
+{
+	sweeps_++;
+	uint64_t low = max_bytes_ / 100 * LOW_WATERMARK_PERCENT;
+	for (size_t steps = clock_.size() * 2; steps > 0 && !clock_.empty() && FileData::total_bytes() > low; steps--) {
+		if (hand_ >= clock_.size()) {
+			hand_ = 0;
+		}
+		MemoryFilePtr file = inodes.get(clock_[hand_]);
+		if (file == nullptr || file->load_state != LoadState::LOADED) {
+			// 已删除或已淘汰, 重新打开时再加入
+			remove(hand_, file);
+			continue;
+		}
+		if (file->referenced.exchange(false)) {
+			hand_++;
+			continue;
+		}
+		if (file->need_flush) {
+			writeback.schedule(file);
+			hand_++;
+			continue;
+		}
+		if (evict(file)) {
+			remove(hand_, file);
+		} else {
+			hand_++;
+		}
+	}
+}
+
+bool Evictor::evict(const MemoryFilePtr& file)
+{
+	// 路径解析要获取父目录的锁, 必须在拿文件锁之前
+	std::string path = get_real_path(get_path_by_file(file));
+	std::unique_lock<std::shared_mutex> lock(file->rw_mutex);
+	if (file->load_state != LoadState::LOADED || file->open_count > 0 || file->need_flush || file->writeback_queued
+		|| file->local_path != path) {
+		return false;
+	}
+	uint64_t bytes = file->data.stored_bytes();
+	file->data.clear();
+	file->load_state = LoadState::NOT_LOADED;
+	file->evicted = true;
+	evictions_++;
+	evicted_bytes_ += bytes;
+	return true;
+}
+
+void Evictor::remove(size_t index, const MemoryFilePtr& file)
+{
+	// 先清除标记再移出, 期间重新打开的文件会经 added_ 重新加入
+	if (file != nullptr) {
+		file->in_clock = false;
+	}
+	clock_[index] = clock_.back();
+	clock_.pop_back();
+}
+
+void Evictor::log_stats(LogLevel level)
+{
+	uint64_t hits = hits_.load();
+	uint64_t total = hits + misses_.load();
+	log_message(level,
+				__FILE__,
+				__LINE__,
+				__func__,
+				"memory budget: %lu of %lu bytes used, %lu evictions (%lu bytes) in %lu sweeps, %lu reloads, "
+				"%lu opens hit ratio %.2f%%\n",
+				FileData::total_bytes(),
+				max_bytes_,
+				evictions_.load(),
+				evicted_bytes_.load(),
+				sweeps_.load(),
+				reloads_.load(),
+				total,
+				total == 0 ? 0.0 : hits * 100.0 / total);
+}
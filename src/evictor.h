@@ -0,0 +1,68 @@
+#ifndef EVICTOR_H
+#define EVICTOR_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "file_data.h"
+#include "log_utils.h"
+#include "mem_fs_file.h"
+
+// 文件内容的内存上限(字节), 0 表示不限制
+struct EvictConfig {
+	uint64_t max_bytes = 0;
+};
+
+// 超过内存上限时按 CLOCK 算法淘汰冷文件的内容, 直到回落到上限的 90% 以下
+// 只统计文件的私有数据块(FileData::total_bytes), 元数据和 mmap 映射不计入
+// 可淘汰的文件: 已加载, 没有打开的句柄, 没有脏数据, 且 target 中的 local_path 就是当前路径(内容可以从那里重新读入)
+// 淘汰后回到 NOT_LOADED, 下次打开时重新加载; 脏的冷文件先交给回写引擎, 写回后在之后的扫描中淘汰
+class Evictor
+{
+  public:
+	static constexpr uint64_t LOW_WATERMARK_PERCENT = 90;
+	~Evictor();
+	int start(const EvictConfig& config);
+	int stop();
+	// 文件打开时调用: 加入 CLOCK, hit 表示打开时内容已在内存中
+	void track(const MemoryFilePtr& file, bool hit);
+	// 文件内容增加后调用, 超过上限时唤醒淘汰线程
+	void check()
+	{
+		if (running_ && FileData::total_bytes() > max_bytes_ && !kicked_) {
+			kick();
+		}
+	}
+	// 被淘汰过的文件重新加载完成
+	void record_reload();
+	void log_stats(LogLevel level);
+
+  private:
+	void kick();
+	void evict_loop();
+	// 转动指针淘汰到低水位以下, 每个文件最多经过两次(第一次清除访问位)
+	void sweep();
+	bool evict(const MemoryFilePtr& file);
+	// 从 CLOCK 中移除 index 处的文件, 最后一个文件移到该位置
+	void remove(size_t index, const MemoryFilePtr& file);
+	std::atomic<bool> running_{false};
+	std::atomic<bool> kicked_{false};
+	uint64_t max_bytes_ = 0;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::thread thread_;
+	// 新打开的文件先放进 added_, 由淘汰线程并入 clock_; clock_ 和 hand_ 只由淘汰线程访问
+	std::vector<uint64_t> added_;
+	std::vector<uint64_t> clock_;
+	size_t hand_ = 0;
+	std::atomic<uint64_t> hits_{0};
+	std::atomic<uint64_t> misses_{0};
+	std::atomic<uint64_t> evictions_{0};
+	std::atomic<uint64_t> evicted_bytes_{0};
+	std::atomic<uint64_t> reloads_{0};
+	std::atomic<uint64_t> sweeps_{0};
+};
+#endif
@@ -0,0 +1,653 @@
+#include "file_data.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+#include <utility>
+
+#include "log_utils.h"
+#include "lz_codec.h"
+#include "slab_allocator.h"
+
+alignas(4096) static const char zero_chunk[FileData::CHUNK_SIZE] = {};
+
+std::atomic<uint64_t> FileData::total_bytes_{0};
+std::atomic<uint64_t> FileData::total_packed_{0};
+std::atomic<uint64_t> FileData::decompressions_{0};
+std::atomic<uint64_t> FileData::decompress_ns_{0};
+
+FileData::Node* FileData::new_node()
+{
+	return new (slab_alloc(sizeof(Node))) Node();
+}
+
+FileData::~FileData()
+{
+	clear();
+}
+
+void FileData::swap(FileData& other)
+{
+	std::swap(root_, other.root_);
+	std::swap(height_, other.height_);
+	std::swap(chunk_count_, other.chunk_count_);
+	std::swap(packed_count_, other.packed_count_);
+	std::swap(packed_bytes_, other.packed_bytes_);
+	std::swap(map_base_, other.map_base_);
+	std::swap(map_len_, other.map_len_);
+	std::swap(map_size_, other.map_size_);
+}
+
+void FileData::attach_mapping(const char* base, uint64_t len, size_t map_size)
+{
+	unmap();
+	map_base_ = base;
+	map_len_ = len;
+	map_size_ = map_size;
+}
+
+void FileData::unmap()
+{
+	if (map_base_ != nullptr) {
+		munmap(const_cast<char*>(map_base_), map_size_);
+	}
+	map_base_ = nullptr;
+	map_len_ = 0;
+	map_size_ = 0;
+}
+
+uint64_t FileData::mapped_bytes() const
+{
+	return map_len_;
+}
+
+uint64_t FileData::capacity() const
+{
+	return height_ == 0 ? 0 : 1ULL << (FANOUT_SHIFT * height_);
+}
+
+bool FileData::is_packed(const void* slot)
+{
+	return (reinterpret_cast<uintptr_t>(slot) & PACKED_TAG) != 0;
+}
+
+FileData::Packed* FileData::to_packed(void* slot)
+{
+	return reinterpret_cast<Packed*>(reinterpret_cast<uintptr_t>(slot) & ~PACKED_TAG);
+}
+
+bool FileData::is_shared(const void* slot)
+{
+	return (reinterpret_cast<uintptr_t>(slot) & SHARED_TAG) != 0;
+}
+
+SharedChunk* FileData::to_shared(void* slot)
+{
+	return reinterpret_cast<SharedChunk*>(reinterpret_cast<uintptr_t>(slot) & ~SHARED_TAG);
+}
+
+size_t FileData::packed_bytes(const Packed* packed)
+{
+	return sizeof(Packed) + packed->count * PIECE_SIZE;
+}
+
+void FileData::free_chunk(void* slot)
+{
+	if (is_packed(slot)) {
+		Packed* packed = to_packed(slot);
+		size_t bytes = packed_bytes(packed);
+		for (uint32_t i = 0; i < packed->count; i++) {
+			slab_free(packed->pieces[i], PIECE_SIZE);
+		}
+		slab_free(packed, sizeof(Packed));
+		packed_count_--;
+		packed_bytes_ -= bytes;
+		total_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+		total_packed_.fetch_sub(1, std::memory_order_relaxed);
+	} else if (is_shared(slot)) {
+		total_bytes_.fetch_sub(ChunkStore::instance().release(to_shared(slot)), std::memory_order_relaxed);
+	} else {
+		slab_free(slot, CHUNK_SIZE);
+		total_bytes_.fetch_sub(CHUNK_SIZE, std::memory_order_relaxed);
+	}
+	chunk_count_--;
+}
+
+void FileData::unpack(void*& slot)
+{
+	auto start = std::chrono::steady_clock::now();
+	Packed* packed = to_packed(slot);
+	size_t bytes = packed_bytes(packed);
+	thread_local std::vector<char> buffer(MAX_PIECES * PIECE_SIZE);
+	for (uint32_t i = 0; i < packed->count; i++) {
+		size_t len = std::min<size_t>(PIECE_SIZE, packed->size - i * PIECE_SIZE);
+		memcpy(buffer.data() + i * PIECE_SIZE, packed->pieces[i], len);
+	}
+	char* chunk = static_cast<char*>(slab_alloc(CHUNK_SIZE));
+	if (!lz_decompress(buffer.data(), packed->size, chunk, CHUNK_SIZE)) {
+		// 压缩数据只在内存中, 解不开说明内存被破坏了, 继续运行只会返回错误的内容
+		LOGE("corrupted compressed chunk\n");
+		abort();
+	}
+	for (uint32_t i = 0; i < packed->count; i++) {
+		slab_free(packed->pieces[i], PIECE_SIZE);
+	}
+	slab_free(packed, sizeof(Packed));
+	slot = chunk;
+	packed_count_--;
+	packed_bytes_ -= bytes;
+	total_bytes_.fetch_add(CHUNK_SIZE - bytes, std::memory_order_relaxed);
+	total_packed_.fetch_sub(1, std::memory_order_relaxed);
+	decompressions_.fetch_add(1, std::memory_order_relaxed);
+	decompress_ns_.fetch_add(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+		std::memory_order_relaxed);
+}
+
+void FileData::break_share(void*& slot)
+{
+	SharedChunk* shared = to_shared(slot);
+	char* chunk = ChunkStore::instance().take(shared);
+	if (chunk == nullptr) {
+		// 还持有引用, 拷贝期间数据不会被释放
+		chunk = static_cast<char*>(slab_alloc(CHUNK_SIZE));
+		memcpy(chunk, shared->data, CHUNK_SIZE);
+		total_bytes_.fetch_add(CHUNK_SIZE - ChunkStore::instance().release(shared), std::memory_order_relaxed);
+	}
+	slot = chunk;
+}
+
+void FileData::dedup_chunk(uint64_t index)
+{
+	void** slot = slot_ref(index);
+	if (slot == nullptr || *slot == nullptr || is_packed(*slot) || is_shared(*slot)) {
+		return;
+	}
+	char* chunk = static_cast<char*>(*slot);
+	SharedChunk* shared = ChunkStore::instance().intern(chunk);
+	if (shared == nullptr) {
+		return;
+	}
+	if (shared->data != chunk) {
+		slab_free(chunk, CHUNK_SIZE);
+		total_bytes_.fetch_sub(CHUNK_SIZE, std::memory_order_relaxed);
+	}
+	*slot = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(shared) | SHARED_TAG);
+}
+
+void FileData::dedup_range(uint64_t offset, size_t size)
+{
+	for (uint64_t index = offset >> CHUNK_SHIFT; index < (offset + size) >> CHUNK_SHIFT; index++) {
+		dedup_chunk(index);
+	}
+}
+
+void* FileData::find_slot(uint64_t index) const
+{
+	if (index >= capacity()) {
+		return nullptr;
+	}
+	Node* node = root_;
+	for (uint32_t level = height_; level > 1; level--) {
+		node = static_cast<Node*>(node->slots[(index >> (FANOUT_SHIFT * (level - 1))) & (FANOUT - 1)]);
+		if (node == nullptr) {
+			return nullptr;
+		}
+	}
+	return node->slots[index & (FANOUT - 1)];
+}
+
+char* FileData::find_chunk(uint64_t index) const
+{
+	void* slot = find_slot(index);
+	if (is_shared(slot)) {
+		return to_shared(slot)->data;
+	}
+	return is_packed(slot) ? nullptr : static_cast<char*>(slot);
+}
+
+void** FileData::slot_ref(uint64_t index)
+{
+	if (index >= capacity()) {
+		return nullptr;
+	}
+	Node* node = root_;
+	for (uint32_t level = height_; level > 1; level--) {
+		node = static_cast<Node*>(node->slots[(index >> (FANOUT_SHIFT * (level - 1))) & (FANOUT - 1)]);
+		if (node == nullptr) {
+			return nullptr;
+		}
+	}
+	return &node->slots[index & (FANOUT - 1)];
+}
+
+void*& FileData::alloc_slot(uint64_t index)
+{
+	while (index >= capacity()) {
+		Node* new_root = new_node();
+		new_root->slots[0] = root_;
+		root_ = new_root;
+		height_++;
+	}
+	Node* node = root_;
+	for (uint32_t level = height_; level > 1; level--) {
+		void*& slot = node->slots[(index >> (FANOUT_SHIFT * (level - 1))) & (FANOUT - 1)];
+		if (slot == nullptr) {
+			slot = new_node();
+		}
+		node = static_cast<Node*>(slot);
+	}
+	return node->slots[index & (FANOUT - 1)];
+}
+
+char* FileData::get_or_alloc_chunk(uint64_t index, bool copy_mapping)
+{
+	void*& slot = alloc_slot(index);
+	if (slot == nullptr) {
+		// 映射覆盖的块先拷贝映射中的内容(写时复制)
+		uint64_t start = index << CHUNK_SHIFT;
+		size_t copied = start < map_len_ && copy_mapping ? std::min(CHUNK_SIZE, map_len_ - start) : 0;
+		slot = slab_alloc(CHUNK_SIZE);
+		if (copied > 0) {
+			memcpy(slot, map_base_ + start, copied);
+		}
+		memset(static_cast<char*>(slot) + copied, 0, CHUNK_SIZE - copied);
+		chunk_count_++;
+		total_bytes_.fetch_add(CHUNK_SIZE, std::memory_order_relaxed);
+	} else if (is_packed(slot)) {
+		unpack(slot);
+	} else if (is_shared(slot)) {
+		break_share(slot);
+	}
+	return static_cast<char*>(slot);
+}
+
+void FileData::share_chunk(uint64_t index, FileData& dst, uint64_t dst_index)
+{
+	if ((index << CHUNK_SHIFT) < map_len_ && find_slot(index) == nullptr) {
+		// 映射提供的块先拷贝成私有块再共享, 只拷贝一次, 之后再克隆这一块只修改块指针
+		get_or_alloc_chunk(index);
+	}
+	void** slot = slot_ref(index);
+	void* chunk = slot == nullptr ? nullptr : *slot;
+	if (chunk != nullptr && is_packed(chunk)) {
+		unpack(*slot);
+		chunk = *slot;
+	}
+	if (chunk != nullptr && !is_shared(chunk)) {
+		// 私有块就地变成共享块, 本文件之后写入时同样要先拷贝
+		SharedChunk* shared = ChunkStore::instance().share(static_cast<char*>(chunk));
+		chunk = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(shared) | SHARED_TAG);
+		*slot = chunk;
+	}
+	if (chunk != nullptr) {
+		ChunkStore::instance().ref(to_shared(chunk));
+	}
+	void** dst_slot = chunk == nullptr ? dst.slot_ref(dst_index) : &dst.alloc_slot(dst_index);
+	if (dst_slot != nullptr && *dst_slot != nullptr) {
+		dst.free_chunk(*dst_slot);
+		*dst_slot = nullptr;
+	}
+	if (chunk != nullptr) {
+		*dst_slot = chunk;
+		dst.chunk_count_++;
+	}
+}
+
+void FileData::clone_range(FileData& src, uint64_t src_off, uint64_t dst_off, uint64_t len, bool share_tail)
+{
+	// 目标范围之后没有映射时, 范围内的映射都会被覆盖, 结束后把映射缩短到 dst_off 即可(src 可能是自身, 不能提前缩短);
+	// 否则目标中映射覆盖且没有私有块的位置不能留成空洞, 这些块单独换成全零块
+	uint64_t dst_start = dst_off;
+	bool cut_mapping = dst_off + len >= map_len_;
+	std::vector<struct iovec> iov;
+	while (len > 0) {
+		uint64_t in_chunk = dst_off & (CHUNK_SIZE - 1);
+		void** src_slot = src.slot_ref(src_off >> CHUNK_SHIFT);
+		bool src_hole = (src_slot == nullptr || *src_slot == nullptr) && src_off >= src.map_len_;
+		bool dst_mapped = !cut_mapping && dst_off < map_len_;
+		if (in_chunk == 0 && (src_off & (CHUNK_SIZE - 1)) == 0 && (len >= CHUNK_SIZE || share_tail)) {
+			if (src_hole && dst_mapped) {
+				void*& slot = alloc_slot(dst_off >> CHUNK_SHIFT);
+				if (slot != nullptr) {
+					free_chunk(slot);
+					slot = nullptr;
+				}
+				get_or_alloc_chunk(dst_off >> CHUNK_SHIFT, false);
+			} else {
+				src.share_chunk(src_off >> CHUNK_SHIFT, *this, dst_off >> CHUNK_SHIFT);
+			}
+			uint64_t done = std::min(CHUNK_SIZE, len);
+			src_off += done;
+			dst_off += done;
+			len -= done;
+			continue;
+		}
+		// 拷贝到源或目标的块尾为止
+		size_t n = std::min({CHUNK_SIZE - in_chunk, CHUNK_SIZE - (src_off & (CHUNK_SIZE - 1)), len});
+		if (src_hole && !dst_mapped && find_slot(dst_off >> CHUNK_SHIFT) == nullptr) {
+			// 两边都是空洞
+		} else {
+			if (src_slot != nullptr && *src_slot != nullptr && is_packed(*src_slot)) {
+				src.unpack(*src_slot);
+			}
+			// 先取目标块: src 是自身且在同一块时, 拷贝成私有块之后再读
+			char* dst = get_or_alloc_chunk(dst_off >> CHUNK_SHIFT) + in_chunk;
+			iov.clear();
+			src.map_read(src_off, n, iov);
+			for (const auto& piece : iov) {
+				memmove(dst, piece.iov_base, piece.iov_len);
+				dst += piece.iov_len;
+			}
+		}
+		src_off += n;
+		dst_off += n;
+		len -= n;
+	}
+	if (cut_mapping) {
+		map_len_ = std::min(map_len_, dst_start);
+	}
+}
+
+void FileData::map_read(uint64_t offset, size_t size, std::vector<struct iovec>& iov) const
+{
+	uint64_t end = offset + size;
+	while (offset < end) {
+		uint64_t in_chunk = offset & (CHUNK_SIZE - 1);
+		size_t len = std::min(CHUNK_SIZE - in_chunk, end - offset);
+		const char* chunk = find_chunk(offset >> CHUNK_SHIFT);
+		if (chunk == nullptr && offset < map_len_) {
+			// 映射只提供到 map_len_, 块内剩余部分下一轮按全零块处理
+			len = std::min<uint64_t>(len, map_len_ - offset);
+			chunk = map_base_ + (offset - in_chunk);
+		} else if (chunk == nullptr) {
+			chunk = zero_chunk;
+		}
+		iov.push_back({const_cast<char*>(chunk) + in_chunk, len});
+		offset += len;
+	}
+}
+
+void FileData::map_write(uint64_t offset, size_t size, std::vector<struct iovec>& iov)
+{
+	uint64_t end = offset + size;
+	while (offset < end) {
+		uint64_t in_chunk = offset & (CHUNK_SIZE - 1);
+		size_t len = std::min(CHUNK_SIZE - in_chunk, end - offset);
+		iov.push_back({get_or_alloc_chunk(offset >> CHUNK_SHIFT) + in_chunk, len});
+		offset += len;
+	}
+}
+
+void FileData::free_node(Node* node, uint32_t level)
+{
+	for (uint64_t i = 0; i < FANOUT; i++) {
+		if (node->slots[i] == nullptr) {
+			continue;
+		}
+		if (level == 1) {
+			free_chunk(node->slots[i]);
+		} else {
+			free_node(static_cast<Node*>(node->slots[i]), level - 1);
+		}
+	}
+	slab_free(node, sizeof(Node));
+}
+
+void FileData::truncate_node(Node* node, uint32_t level, uint64_t first_index, uint64_t keep_chunks)
+{
+	uint64_t span = 1ULL << (FANOUT_SHIFT * (level - 1));
+	for (uint64_t i = 0; i < FANOUT; i++) {
+		uint64_t child_index = first_index + i * span;
+		if (node->slots[i] == nullptr || child_index + span <= keep_chunks) {
+			continue;
+		}
+		if (child_index >= keep_chunks) {
+			if (level == 1) {
+				free_chunk(node->slots[i]);
+			} else {
+				free_node(static_cast<Node*>(node->slots[i]), level - 1);
+			}
+			node->slots[i] = nullptr;
+		} else {
+			truncate_node(static_cast<Node*>(node->slots[i]), level - 1, child_index, keep_chunks);
+		}
+	}
+}
+
+void FileData::truncate(uint64_t size)
+{
+	uint64_t keep_chunks = (size + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+	if (keep_chunks == 0) {
+		clear();
+		return;
+	}
+	// 截断后映射中超出 size 的部分不再读取, 之后即使文件变大也读到零
+	map_len_ = std::min(map_len_, size);
+	if (root_ != nullptr && keep_chunks < capacity()) {
+		truncate_node(root_, height_, 0, keep_chunks);
+	}
+	uint64_t in_chunk = size & (CHUNK_SIZE - 1);
+	if (in_chunk != 0 && find_slot(size >> CHUNK_SHIFT) != nullptr) {
+		memset(get_or_alloc_chunk(size >> CHUNK_SHIFT) + in_chunk, 0, CHUNK_SIZE - in_chunk);
+	}
+}
+
+void FileData::allocate(uint64_t offset, uint64_t size)
+{
+	if (size == 0) {
+		return;
+	}
+	for (uint64_t index = offset >> CHUNK_SHIFT; index <= (offset + size - 1) >> CHUNK_SHIFT; index++) {
+		if (find_slot(index) == nullptr) {
+			get_or_alloc_chunk(index);
+		}
+	}
+}
+
+void FileData::zero_range(uint64_t offset, uint64_t size, bool punch_hole)
+{
+	uint64_t end = offset + size;
+	// 范围一直到映射结尾时缩短映射即可; 否则空洞处会读到映射, 范围内映射覆盖的块要换成私有块
+	if (end >= map_len_) {
+		map_len_ = std::min(map_len_, offset);
+	}
+	while (offset < end) {
+		uint64_t index = offset >> CHUNK_SHIFT;
+		uint64_t in_chunk = offset & (CHUNK_SIZE - 1);
+		uint64_t len = std::min(CHUNK_SIZE - in_chunk, end - offset);
+		void** slot = slot_ref(index);
+		bool empty = slot == nullptr || *slot == nullptr;
+		bool mapped = offset < map_len_;
+		if (empty && !mapped) {
+			if (punch_hole) {
+				// 跳过整段空洞, 打大范围的洞时不逐块检查
+				uint64_t next = index < capacity() ? next_chunk(root_, height_, 0, index) : NO_DATA;
+				if (next == NO_DATA) {
+					break;
+				}
+				offset = std::max(offset + len, next << CHUNK_SHIFT);
+				continue;
+			}
+			get_or_alloc_chunk(index);
+		} else if (len == CHUNK_SIZE && (empty || is_packed(*slot) || is_shared(*slot) || (punch_hole && !mapped))) {
+			if (!empty) {
+				free_chunk(*slot);
+				*slot = nullptr;
+			}
+			if (!punch_hole || mapped) {
+				get_or_alloc_chunk(index, false);
+			}
+		} else {
+			memset(get_or_alloc_chunk(index) + in_chunk, 0, len);
+		}
+		offset += len;
+	}
+}
+
+void FileData::clear()
+{
+	if (root_ != nullptr) {
+		free_node(root_, height_);
+	}
+	root_ = nullptr;
+	height_ = 0;
+	chunk_count_ = 0;
+	packed_count_ = 0;
+	packed_bytes_ = 0;
+	unmap();
+}
+
+// 在 node(第 level 层, 首块号 first_index)下找块号不小于 from 的第一个已分配块, 跳过整棵空子树
+uint64_t FileData::next_chunk(const Node* node, uint32_t level, uint64_t first_index, uint64_t from) const
+{
+	uint64_t span = 1ULL << (FANOUT_SHIFT * (level - 1));
+	for (uint64_t i = from > first_index ? (from - first_index) / span : 0; i < FANOUT; i++) {
+		if (node->slots[i] == nullptr) {
+			continue;
+		}
+		uint64_t child_index = first_index + i * span;
+		if (level == 1) {
+			return child_index;
+		}
+		uint64_t found = next_chunk(static_cast<const Node*>(node->slots[i]), level - 1, child_index, from);
+		if (found != NO_DATA) {
+			return found;
+		}
+	}
+	return NO_DATA;
+}
+
+uint64_t FileData::next_data(uint64_t offset) const
+{
+	// 映射部分整体当作数据, 不区分 target 文件中的空洞
+	if (offset < map_len_) {
+		return offset;
+	}
+	uint64_t index = offset >> CHUNK_SHIFT;
+	if (index >= capacity()) {
+		return NO_DATA;
+	}
+	uint64_t found = next_chunk(root_, height_, 0, index);
+	if (found == NO_DATA) {
+		return NO_DATA;
+	}
+	return found == index ? offset : found << CHUNK_SHIFT;
+}
+
+uint64_t FileData::next_hole(uint64_t offset) const
+{
+	offset = std::max(offset, map_len_);
+	uint64_t index = offset >> CHUNK_SHIFT;
+	if (find_slot(index) == nullptr) {
+		return offset;
+	}
+	// 连续的已分配块都占着内存, 逐块走不会比数据本身多
+	while (find_slot(index) != nullptr) {
+		index++;
+	}
+	return index << CHUNK_SHIFT;
+}
+
+uint64_t FileData::chunk_count() const
+{
+	return chunk_count_;
+}
+
+uint64_t FileData::stored_bytes() const
+{
+	return (chunk_count_ - packed_count_) * CHUNK_SIZE + packed_bytes_;
+}
+
+bool FileData::has_compressed(uint64_t offset, size_t size) const
+{
+	if (packed_count_ == 0 || size == 0) {
+		return false;
+	}
+	for (uint64_t index = offset >> CHUNK_SHIFT; index <= (offset + size - 1) >> CHUNK_SHIFT; index++) {
+		if (is_packed(find_slot(index))) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void FileData::decompress_range(uint64_t offset, size_t size)
+{
+	if (packed_count_ == 0 || size == 0) {
+		return;
+	}
+	for (uint64_t index = offset >> CHUNK_SHIFT; index <= (offset + size - 1) >> CHUNK_SHIFT; index++) {
+		void** slot = slot_ref(index);
+		if (slot != nullptr && is_packed(*slot)) {
+			unpack(*slot);
+		}
+	}
+}
+
+uint64_t FileData::compress_chunks(uint64_t index, size_t max_chunks, uint64_t& raw_bytes, uint64_t& compressed_bytes)
+{
+	thread_local std::vector<char> buffer(MAX_PIECES * PIECE_SIZE);
+	while (max_chunks > 0) {
+		if (index >= capacity()) {
+			return NO_DATA;
+		}
+		index = next_chunk(root_, height_, 0, index);
+		if (index == NO_DATA) {
+			return NO_DATA;
+		}
+		void*& slot = *slot_ref(index);
+		index++;
+		// 共享块由多个文件引用, 不压缩
+		if (is_packed(slot) || is_shared(slot)) {
+			continue;
+		}
+		max_chunks--;
+		size_t size = lz_compress(static_cast<char*>(slot), CHUNK_SIZE, buffer.data(), buffer.size());
+		if (size == 0) {
+			continue;
+		}
+		Packed* packed = static_cast<Packed*>(slab_alloc(sizeof(Packed)));
+		packed->size = size;
+		packed->count = (size + PIECE_SIZE - 1) / PIECE_SIZE;
+		for (uint32_t i = 0; i < packed->count; i++) {
+			packed->pieces[i] = static_cast<char*>(slab_alloc(PIECE_SIZE));
+			size_t len = std::min<size_t>(PIECE_SIZE, size - i * PIECE_SIZE);
+			memcpy(packed->pieces[i], buffer.data() + i * PIECE_SIZE, len);
+		}
+		slab_free(slot, CHUNK_SIZE);
+		// slab 对象至少 16 字节对齐, 低两位用作压缩和共享标记
+		slot = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(packed) | PACKED_TAG);
+		size_t bytes = packed_bytes(packed);
+		packed_count_++;
+		packed_bytes_ += bytes;
+		total_bytes_.fetch_sub(CHUNK_SIZE - bytes, std::memory_order_relaxed);
+		total_packed_.fetch_add(1, std::memory_order_relaxed);
+		raw_bytes += CHUNK_SIZE;
+		compressed_bytes += bytes;
+	}
+	return index;
+}
+
+uint64_t FileData::total_bytes()
+{
+	return total_bytes_.load(std::memory_order_relaxed);
+}
+
+uint64_t FileData::total_compressed()
+{
+	return total_packed_.load(std::memory_order_relaxed);
+}
+
+uint64_t FileData::decompressions()
+{
+	return decompressions_.load(std::memory_order_relaxed);
+}
+
+uint64_t FileData::decompress_ns()
+{
+	return decompress_ns_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,132 @@
+#ifndef FILE_DATA_H
+#define FILE_DATA_H
+#include <atomic>
+#include <cstdint>
+#include <sys/uio.h>
+#include <vector>
+
+#include "chunk_store.h"
+
+// 文件内容按 64KiB 分块存放, 块号 -> 块的映射是一棵基数树(每层 512 路, 高度随文件大小增长)
+// 追加写只分配新块, 不会移动或拷贝已有数据; 从未写过的块不分配, 读到的是全零块
+// 也可以挂上 target 文件的只读私有映射作为底层内容: 没有私有块的位置直接读映射, 第一次写某块时才拷贝成私有块
+// 冷数据块可以压缩存放(槽位指针最低位为 1), 压缩数据切成 4KiB 的片, 写或截断到该块时自动解压;
+// 开启去重时块可以是 ChunkStore 中与其他文件共享的只读块(槽位指针第 1 位为 1), 写或截断到该块时拷贝成私有块;
+// 读之前调用者要先用 decompress_range 解压读取范围, map_read 不处理压缩块
+// 数据块和树节点都从 slab 分配器分配. 不加锁, 由所属 MemoryFile 的 rw_mutex 保护
+class FileData
+{
+  public:
+	static constexpr uint64_t CHUNK_SHIFT = 16;
+	static constexpr uint64_t CHUNK_SIZE = 1ULL << CHUNK_SHIFT;
+	static constexpr uint32_t FANOUT_SHIFT = 9;
+	static constexpr uint64_t FANOUT = 1ULL << FANOUT_SHIFT;
+	FileData() = default;
+	~FileData();
+	FileData(const FileData&) = delete;
+	FileData& operator=(const FileData&) = delete;
+	// 把 [offset, offset + size) 按块拆成 iovec 追加到 iov, 未分配的块指向全零块
+	void map_read(uint64_t offset, size_t size, std::vector<struct iovec>& iov) const;
+	// 分配 [offset, offset + size) 覆盖的块并拆成 iovec 追加到 iov
+	void map_write(uint64_t offset, size_t size, std::vector<struct iovec>& iov);
+	// 释放 size 之后的整块, 并把 size 所在块的剩余部分清零
+	void truncate(uint64_t size);
+	// 预分配 [offset, offset + size) 中还没有的块, 之后写入这些位置不再分配; 已有的块(包括共享和压缩的)不变
+	void allocate(uint64_t offset, uint64_t size);
+	// 把 [offset, offset + size) 清零, 两端不满一块的部分就地清零; 中间的整块 punch_hole 时释放成空洞,
+	// 否则保留为全零的私有块(已有的普通块直接清零, 共享和压缩的块换成新块). 映射覆盖的块不会成为空洞,
+	// 范围一直到映射结尾时只缩短映射
+	void zero_range(uint64_t offset, uint64_t size, bool punch_hole);
+	void clear();
+	void swap(FileData& other);
+	// 以映射 [base, base + len) 作为文件内容, 接管映射(大小为 map_size), 只能在空的 FileData 上调用
+	// 映射在 clear 或被截断为 0 时 munmap
+	void attach_mapping(const char* base, uint64_t len, size_t map_size);
+	// 仍由映射提供的字节数(映射之后被截断的部分不算)
+	uint64_t mapped_bytes() const;
+	// 返回不小于 offset 的第一个落在已分配块中的位置, 没有则返回 NO_DATA
+	uint64_t next_data(uint64_t offset) const;
+	// 返回不小于 offset 的第一个落在空洞(未分配块)中的位置
+	uint64_t next_hole(uint64_t offset) const;
+	// 已分配的块数, 包括压缩的块
+	uint64_t chunk_count() const;
+	// 私有块实际占用的字节数, 压缩块按压缩后的大小计
+	uint64_t stored_bytes() const;
+	// [offset, offset + size) 中是否有压缩块
+	bool has_compressed(uint64_t offset, size_t size) const;
+	void decompress_range(uint64_t offset, size_t size);
+	// 从块号 index 开始压缩最多 max_chunks 个未压缩的块, 压缩后省不到 1/4 的块保持原样
+	// 返回下一个要检查的块号, 没有更多块时返回 NO_DATA; 压缩前后的字节数累加到 raw_bytes 和 compressed_bytes
+	uint64_t compress_chunks(uint64_t index, size_t max_chunks, uint64_t& raw_bytes, uint64_t& compressed_bytes);
+	// 把第 index 块登记到 ChunkStore, 与内容相同的块共享
+	void dedup_chunk(uint64_t index);
+	// 去重在 [offset, offset + size) 内结束的整块, 即这次写入写到块尾的块
+	void dedup_range(uint64_t offset, size_t size);
+	// 把 src 的 [src_off, src_off + len) 复制到本文件的 dst_off 处: 两边都按块对齐的整块与 src 共享(写时复制),
+	// 只修改块指针, src 中来自映射的块第一次共享时拷贝成私有块; 其余部分逐字节拷贝. share_tail 表示 len 之后的字节
+	// 在两边都可以视为零, 结尾不满一块的部分也可以共享. src 可以是自身, 范围不能重叠
+	void clone_range(FileData& src, uint64_t src_off, uint64_t dst_off, uint64_t len, bool share_tail);
+	// 所有 FileData 的私有块占用的字节数, 共享块只算一份
+	static uint64_t total_bytes();
+	// 所有 FileData 中的压缩块数和解压统计
+	static uint64_t total_compressed();
+	static uint64_t decompressions();
+	static uint64_t decompress_ns();
+	static constexpr uint64_t NO_DATA = UINT64_MAX;
+
+  private:
+	struct Node {
+		void* slots[FANOUT] = {};
+	};
+	static constexpr size_t PIECE_SIZE = 4096;
+	static constexpr size_t MAX_PIECES = CHUNK_SIZE / PIECE_SIZE * 3 / 4;
+	// 压缩块: size 字节的压缩数据依次放在 pieces 片中
+	struct Packed {
+		uint32_t size;
+		uint32_t count;
+		char* pieces[MAX_PIECES];
+	};
+	static Node* new_node();
+	static constexpr uintptr_t PACKED_TAG = 1;
+	static constexpr uintptr_t SHARED_TAG = 2;
+	static bool is_packed(const void* slot);
+	static Packed* to_packed(void* slot);
+	static bool is_shared(const void* slot);
+	static SharedChunk* to_shared(void* slot);
+	static size_t packed_bytes(const Packed* packed);
+	// 释放槽位指向的块(普通块或压缩块)
+	void free_chunk(void* slot);
+	uint64_t capacity() const;
+	void* find_slot(uint64_t index) const;
+	// 返回块的数据(共享块只能读), 不存在或已压缩时返回 nullptr
+	char* find_chunk(uint64_t index) const;
+	// 指向第 1 层槽位的指针, 所在节点不存在时返回 nullptr
+	void** slot_ref(uint64_t index);
+	// 第 index 块的槽位, 需要时创建中间节点
+	void*& alloc_slot(uint64_t index);
+	// 让 dst 的第 dst_index 块与本文件的第 index 块共享, 该块由映射提供时先拷贝成私有块
+	void share_chunk(uint64_t index, FileData& dst, uint64_t dst_index);
+	void unpack(void*& slot);
+	void break_share(void*& slot);
+	// copy_mapping 为 false 时新块不拷贝映射的内容, 为全零
+	char* get_or_alloc_chunk(uint64_t index, bool copy_mapping = true);
+	uint64_t next_chunk(const Node* node, uint32_t level, uint64_t first_index, uint64_t from) const;
+	void free_node(Node* node, uint32_t level);
+	void unmap();
+	void truncate_node(Node* node, uint32_t level, uint64_t first_index, uint64_t keep_chunks);
+	// root_ 在第 height_ 层, 第 1 层的槽位直接指向数据块
+	Node* root_ = nullptr;
+	uint32_t height_ = 0;
+	uint64_t chunk_count_ = 0;
+	uint64_t packed_count_ = 0;
+	uint64_t packed_bytes_ = 0;
+	// [0, map_len_) 中没有私有块的部分读映射
+	const char* map_base_ = nullptr;
+	uint64_t map_len_ = 0;
+	size_t map_size_ = 0;
+	static std::atomic<uint64_t> total_bytes_;
+	static std::atomic<uint64_t> total_packed_;
+	static std::atomic<uint64_t> decompressions_;
+	static std::atomic<uint64_t> decompress_ns_;
+};
+#endif
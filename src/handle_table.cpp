@@ -0,0 +1,125 @@
+#include "handle_table.h"
+
+#include <cerrno>
+
+static constexpr uint32_t FREE_NIL = UINT32_MAX;
+
+static inline uint64_t make_head(uint32_t tag, uint32_t index)
+{
+	return (static_cast<uint64_t>(tag) << 32) | index;
+}
+
+HandleTable::HandleTable()
+	: free_head_(make_head(0, FREE_NIL))
+{
+	for (auto& segment : segments_) {
+		segment.store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+HandleTable::~HandleTable()
+{
+	for (auto& segment : segments_) {
+		delete segment.load(std::memory_order_relaxed);
+	}
+}
+
+HandleTable::Slot* HandleTable::slot_at(uint32_t index)
+{
+	Segment* segment = segments_[index >> SEGMENT_SHIFT].load(std::memory_order_acquire);
+	if (segment == nullptr) {
+		return nullptr;
+	}
+	return &segment->slots[index & (SEGMENT_SIZE - 1)];
+}
+
+void HandleTable::push_free(uint32_t index)
+{
+	Slot* slot = slot_at(index);
+	uint64_t head = free_head_.load(std::memory_order_relaxed);
+	uint64_t new_head;
+	do {
+		slot->next_free.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+		new_head = make_head(static_cast<uint32_t>(head >> 32) + 1, index);
+	} while (!free_head_.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed));
+}
+
+bool HandleTable::pop_free(uint32_t& index)
+{
+	uint64_t head = free_head_.load(std::memory_order_acquire);
+	while (static_cast<uint32_t>(head) != FREE_NIL) {
+		uint32_t next = slot_at(static_cast<uint32_t>(head))->next_free.load(std::memory_order_relaxed);
+		uint64_t new_head = make_head(static_cast<uint32_t>(head >> 32) + 1, next);
+		if (free_head_.compare_exchange_weak(head, new_head, std::memory_order_acquire, std::memory_order_acquire)) {
+			index = static_cast<uint32_t>(head);
+			return true;
+		}
+	}
+	return false;
+}
+
+int32_t HandleTable::alloc(const MemoryFilePtr& file, mode_t mode, uint64_t& fh)
+{
+	uint32_t index;
+	if (!pop_free(index)) {
+		index = next_unused_.fetch_add(1);
+		if (index >= MAX_SEGMENTS * SEGMENT_SIZE) {
+			next_unused_.fetch_sub(1);
+			return -EMFILE;
+		}
+		auto& segment = segments_[index >> SEGMENT_SHIFT];
+		if (segment.load(std::memory_order_acquire) == nullptr) {
+			Segment* new_segment = new Segment();
+			Segment* expected = nullptr;
+			if (!segment.compare_exchange_strong(expected, new_segment, std::memory_order_acq_rel)) {
+				delete new_segment;
+			}
+		}
+	}
+	Slot* slot = slot_at(index);
+	slot->fd.mode = mode;
+	slot->fd.file = file;
+	uint32_t generation = slot->generation.load(std::memory_order_relaxed) + 1;
+	slot->generation.store(generation, std::memory_order_release);
+	open_count_.fetch_add(1, std::memory_order_relaxed);
+	fh = (static_cast<uint64_t>(generation) << 32) | index;
+	return 0;
+}
+
+Fd* HandleTable::get(uint64_t fh)
+{
+	uint32_t index = static_cast<uint32_t>(fh);
+	uint32_t generation = static_cast<uint32_t>(fh >> 32);
+	if ((generation & 1) == 0 || index >= next_unused_.load(std::memory_order_acquire)) {
+		return nullptr;
+	}
+	Slot* slot = slot_at(index);
+	if (slot == nullptr || slot->generation.load(std::memory_order_acquire) != generation) {
+		return nullptr;
+	}
+	return &slot->fd;
+}
+
+int32_t HandleTable::release(uint64_t fh)
+{
+	Fd* fd = get(fh);
+	if (fd == nullptr) {
+		return -EBADF;
+	}
+	uint32_t index = static_cast<uint32_t>(fh);
+	Slot* slot = slot_at(index);
+	uint32_t generation = static_cast<uint32_t>(fh >> 32);
+	// 代数变为偶数, 之后持有旧 fh 的 get 都会失败
+	if (!slot->generation.compare_exchange_strong(generation, generation + 1, std::memory_order_acq_rel)) {
+		return -EBADF;
+	}
+	fd->file.reset();
+	open_count_.fetch_sub(1, std::memory_order_relaxed);
+	push_free(index);
+	return 0;
+}
+
+size_t HandleTable::size()
+{
+	return open_count_.load(std::memory_order_relaxed);
+}
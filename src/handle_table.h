@@ -0,0 +1,41 @@
+#ifndef HANDLE_TABLE_H
+#define HANDLE_TABLE_H
+#include <atomic>
+#include <cstdint>
+
+#include "mem_fs_file.h"
+
+// 打开文件句柄表: 分段数组保证槽位地址稳定, 空闲槽位用无锁栈管理, 分配和释放都是 O(1)
+// fh 高 32 位是槽位的代数(奇数表示正在使用), 低 32 位是槽位下标, 释放后旧 fh 自动失效
+class HandleTable
+{
+  public:
+	static constexpr uint32_t SEGMENT_SHIFT = 10;
+	static constexpr uint32_t SEGMENT_SIZE = 1u << SEGMENT_SHIFT;
+	static constexpr uint32_t MAX_SEGMENTS = 4096;
+	HandleTable();
+	~HandleTable();
+	int32_t alloc(const MemoryFilePtr& file, mode_t mode, uint64_t& fh);
+	Fd* get(uint64_t fh);
+	int32_t release(uint64_t fh);
+	size_t size();
+
+  private:
+	struct Slot {
+		std::atomic<uint32_t> generation{0};
+		std::atomic<uint32_t> next_free{0};
+		Fd fd;
+	};
+	struct Segment {
+		Slot slots[SEGMENT_SIZE];
+	};
+	Slot* slot_at(uint32_t index);
+	void push_free(uint32_t index);
+	bool pop_free(uint32_t& index);
+	std::atomic<Segment*> segments_[MAX_SEGMENTS];
+	// 低 32 位为栈顶槽位下标, 高 32 位为版本号, 用于避免 ABA
+	std::atomic<uint64_t> free_head_;
+	std::atomic<uint32_t> next_unused_{0};
+	std::atomic<size_t> open_count_{0};
+};
+#endif
@@ -0,0 +1,59 @@
+#include "inode_table.h"
+
+#include <cerrno>
+#include <mutex>
+
+InodeTable::Shard& InodeTable::shard_of(uint64_t ino)
+{
+	return shards_[ino % SHARD_COUNT];
+}
+
+uint64_t InodeTable::insert(const MemoryFilePtr& file)
+{
+	file->ino = next_ino_.fetch_add(1);
+	Shard& shard = shard_of(file->ino);
+	std::unique_lock<std::shared_mutex> lock(shard.mutex);
+	shard.inodes[file->ino] = file;
+	return file->ino;
+}
+
+MemoryFilePtr InodeTable::get(uint64_t ino)
+{
+	Shard& shard = shard_of(ino);
+	std::shared_lock<std::shared_mutex> lock(shard.mutex);
+	auto it = shard.inodes.find(ino);
+	if (it == shard.inodes.end()) {
+		return nullptr;
+	}
+	return it->second;
+}
+
+int InodeTable::erase(uint64_t ino)
+{
+	Shard& shard = shard_of(ino);
+	std::unique_lock<std::shared_mutex> lock(shard.mutex);
+	if (shard.inodes.erase(ino) == 0) {
+		return -ENOENT;
+	}
+	return 0;
+}
+
+size_t InodeTable::size()
+{
+	size_t total = 0;
+	for (auto& shard : shards_) {
+		std::shared_lock<std::shared_mutex> lock(shard.mutex);
+		total += shard.inodes.size();
+	}
+	return total;
+}
+
+void InodeTable::for_each(const std::function<void(const MemoryFilePtr&)>& func)
+{
+	for (auto& shard : shards_) {
+		std::shared_lock<std::shared_mutex> lock(shard.mutex);
+		for (const auto& inode : shard.inodes) {
+			func(inode.second);
+		}
+	}
+}
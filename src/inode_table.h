@@ -0,0 +1,34 @@
+#ifndef INODE_TABLE_H
+#define INODE_TABLE_H
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "mem_fs_file.h"
+
+// inode 号 -> MemoryFile, 表持有文件的所有权, 打开的句柄另持有一份引用
+// 按 inode 号分片加锁, 分片锁是叶子锁: 持有分片锁时不会再获取任何其他锁
+class InodeTable
+{
+  public:
+	static constexpr uint64_t ROOT_INO = 1;
+	static constexpr size_t SHARD_COUNT = 64;
+	uint64_t insert(const MemoryFilePtr& file);
+	MemoryFilePtr get(uint64_t ino);
+	int erase(uint64_t ino);
+	size_t size();
+	void for_each(const std::function<void(const MemoryFilePtr&)>& func);
+
+  private:
+	struct alignas(64) Shard {
+		std::shared_mutex mutex;
+		std::unordered_map<uint64_t, MemoryFilePtr> inodes;
+	};
+	Shard& shard_of(uint64_t ino);
+	std::array<Shard, SHARD_COUNT> shards_;
+	std::atomic<uint64_t> next_ino_{ROOT_INO};
+};
+#endif
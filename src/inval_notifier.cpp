@@ -0,0 +1,85 @@
+#include "inval_notifier.h"
+
+InvalNotifier::~InvalNotifier()
+{
+	stop();
+}
+
+int InvalNotifier::start(InodeSink inode_sink, EntrySink entry_sink)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!running_) {
+		inode_sink_ = inode_sink;
+		entry_sink_ = entry_sink;
+		running_ = true;
+		enabled_ = true;
+		notify_thread_ = std::thread(&InvalNotifier::notify_loop, this);
+	}
+	return 0;
+}
+
+int InvalNotifier::stop()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!running_) {
+		return 0;
+	}
+	running_ = false;
+	enabled_ = false;
+	lock.unlock();
+	cond_.notify_all();
+	if (notify_thread_.joinable()) {
+		notify_thread_.join();
+	}
+	return 0;
+}
+
+void InvalNotifier::inval_inode(uint64_t ino)
+{
+	if (!enabled_) {
+		return;
+	}
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (inodes_.insert(ino).second) {
+		cond_.notify_one();
+	}
+}
+
+void InvalNotifier::inval_entry(uint64_t parent, const std::string& name)
+{
+	if (!enabled_) {
+		return;
+	}
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (entries_.emplace(parent, name).second) {
+		cond_.notify_one();
+	}
+}
+
+uint64_t InvalNotifier::sent()
+{
+	return sent_.load(std::memory_order_relaxed);
+}
+
+void InvalNotifier::notify_loop()
+{
+	std::unordered_set<uint64_t> inodes;
+	std::set<std::pair<uint64_t, std::string>> entries;
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (running_) {
+		cond_.wait(lock, [this] { return !running_ || !inodes_.empty() || !entries_.empty(); });
+		inodes.swap(inodes_);
+		entries.swap(entries_);
+		lock.unlock();
+		for (const auto& entry : entries) {
+			entry_sink_(entry.first, entry.second);
+		}
+		for (uint64_t ino : inodes) {
+			inode_sink_(ino);
+		}
+		sent_.fetch_add(entries.size() + inodes.size(), std::memory_order_relaxed);
+		inodes.clear();
+		entries.clear();
+		lock.lock();
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef INVAL_NOTIFIER_H
+#define INVAL_NOTIFIER_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+
+// 通知内核丢弃缓存的属性和目录项
+// 内核处理 inval_entry 时要获取父目录的 inode 锁, 在请求处理路径上同步发送可能与该请求本身死锁,
+// 所以修改路径只把通知放进队列(同一对象合并), 由后台线程发送. 未 start 时入队直接忽略
+class InvalNotifier
+{
+  public:
+	using InodeSink = std::function<void(uint64_t ino)>;
+	using EntrySink = std::function<void(uint64_t parent, const std::string& name)>;
+	~InvalNotifier();
+	int start(InodeSink inode_sink, EntrySink entry_sink);
+	int stop();
+	void inval_inode(uint64_t ino);
+	void inval_entry(uint64_t parent, const std::string& name);
+	uint64_t sent();
+
+  private:
+	void notify_loop();
+	InodeSink inode_sink_;
+	EntrySink entry_sink_;
+	std::atomic<bool> enabled_{false};
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	bool running_ = false;
+	std::unordered_set<uint64_t> inodes_;
+	std::set<std::pair<uint64_t, std::string>> entries_;
+	std::atomic<uint64_t> sent_{0};
+	std::thread notify_thread_;
+};
+#endif
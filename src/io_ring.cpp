@@ -0,0 +1,360 @@
+#include "io_ring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef MEMFS_HAVE_IO_URING
+#include <linux/io_uring.h>
+
+IoRing::~IoRing()
+{
+	if (ring_fd_ < 0) {
+		return;
+	}
+	wait_all();
+	destroy();
+}
+
+void IoRing::destroy()
+{
+	if (ring_fd_ < 0) {
+		return;
+	}
+	munmap(sqes_, sqes_size_);
+	if (cq_ring_ != sq_ring_) {
+		munmap(cq_ring_, cq_ring_size_);
+	}
+	munmap(sq_ring_, sq_ring_size_);
+	::close(ring_fd_);
+	ring_fd_ = -1;
+}
+
+void IoRing::fail_all(int err)
+{
+	destroy();
+	to_submit_ = 0;
+	inflight_ = 0;
+	free_slots_.clear();
+	for (uint32_t i = depth_; i > 0; i--) {
+		free_slots_.push_back(i - 1);
+	}
+	// 先全部取出再调用, callback 中可以再提交请求(会立即以错误结束)
+	std::vector<Callback> callbacks;
+	callbacks.swap(callbacks_);
+	callbacks_.resize(depth_);
+	for (auto& callback : callbacks) {
+		if (callback) {
+			callback(err);
+		}
+	}
+}
+
+int IoRing::init(unsigned int depth)
+{
+	if (ring_fd_ >= 0) {
+		return 0;
+	}
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int fd = syscall(__NR_io_uring_setup, depth, &params);
+	if (fd < 0) {
+		return -errno;
+	}
+	sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap) {
+		sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+	}
+	sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq_ring_ == MAP_FAILED) {
+		int ret = -errno;
+		::close(fd);
+		return ret;
+	}
+	cq_ring_ = single_mmap ? sq_ring_
+						   : mmap(nullptr,
+								  cq_ring_size_,
+								  PROT_READ | PROT_WRITE,
+								  MAP_SHARED | MAP_POPULATE,
+								  fd,
+								  IORING_OFF_CQ_RING);
+	sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+	void* sqes = cq_ring_ == MAP_FAILED ? MAP_FAILED
+										: mmap(nullptr,
+											   sqes_size_,
+											   PROT_READ | PROT_WRITE,
+											   MAP_SHARED | MAP_POPULATE,
+											   fd,
+											   IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		int ret = -errno;
+		if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+			munmap(cq_ring_, cq_ring_size_);
+		}
+		munmap(sq_ring_, sq_ring_size_);
+		::close(fd);
+		return ret;
+	}
+	sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+	char* sq = static_cast<char*>(sq_ring_);
+	char* cq = static_cast<char*>(cq_ring_);
+	sq_head_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+	sq_tail_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+	sq_mask_ = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+	sq_entries_ = params.sq_entries;
+	sq_array_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+	cq_head_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+	cq_tail_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+	cq_mask_ = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+	cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+	// 在途请求不超过 SQ 长度, CQ 至少与 SQ 一样长, 不会溢出
+	depth_ = params.sq_entries;
+	callbacks_.resize(depth_);
+	free_slots_.clear();
+	for (uint32_t i = depth_; i > 0; i--) {
+		free_slots_.push_back(i - 1);
+	}
+	ring_fd_ = fd;
+	return 0;
+}
+
+bool IoRing::ready() const
+{
+	return ring_fd_ >= 0;
+}
+
+struct io_uring_sqe* IoRing::get_sqe(Callback callback)
+{
+	while (ring_fd_ >= 0 && inflight_ >= depth_) {
+		// 队列已满: 提交并至少等待一个完成
+		int ret = submit(1);
+		if (ret < 0) {
+			fail_all(ret);
+			break;
+		}
+		reap();
+	}
+	if (ring_fd_ < 0) {
+		if (callback) {
+			callback(-ECANCELED);
+		}
+		return nullptr;
+	}
+	uint32_t slot = free_slots_.back();
+	free_slots_.pop_back();
+	callbacks_[slot] = std::move(callback);
+	unsigned int tail = *sq_tail_;
+	unsigned int index = tail & sq_mask_;
+	struct io_uring_sqe* sqe = &sqes_[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = slot;
+	sq_array_[index] = index;
+	__atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+	to_submit_++;
+	inflight_++;
+	return sqe;
+}
+
+void IoRing::openat(int dirfd, const char* path, int flags, mode_t mode, Callback callback)
+{
+	struct io_uring_sqe* sqe = get_sqe(std::move(callback));
+	if (sqe == nullptr) {
+		return;
+	}
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = dirfd;
+	sqe->addr = reinterpret_cast<uint64_t>(path);
+	sqe->len = mode;
+	sqe->open_flags = flags;
+}
+
+void IoRing::readv(int fd, const struct iovec* iov, int count, uint64_t offset, Callback callback)
+{
+	struct io_uring_sqe* sqe = get_sqe(std::move(callback));
+	if (sqe == nullptr) {
+		return;
+	}
+	sqe->opcode = IORING_OP_READV;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<uint64_t>(iov);
+	sqe->len = count;
+	sqe->off = offset;
+}
+
+void IoRing::writev(int fd, const struct iovec* iov, int count, uint64_t offset, Callback callback)
+{
+	struct io_uring_sqe* sqe = get_sqe(std::move(callback));
+	if (sqe == nullptr) {
+		return;
+	}
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<uint64_t>(iov);
+	sqe->len = count;
+	sqe->off = offset;
+}
+
+void IoRing::fsync(int fd, bool datasync, Callback callback)
+{
+	struct io_uring_sqe* sqe = get_sqe(std::move(callback));
+	if (sqe == nullptr) {
+		return;
+	}
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->fd = fd;
+	sqe->fsync_flags = datasync ? IORING_FSYNC_DATASYNC : 0;
+}
+
+void IoRing::close(int fd, Callback callback)
+{
+	struct io_uring_sqe* sqe = get_sqe(std::move(callback));
+	if (sqe == nullptr) {
+		return;
+	}
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = fd;
+}
+
+void IoRing::statx(int dirfd, const char* path, int flags, unsigned int mask, struct statx* buf, Callback callback)
+{
+	struct io_uring_sqe* sqe = get_sqe(std::move(callback));
+	if (sqe == nullptr) {
+		return;
+	}
+	sqe->opcode = IORING_OP_STATX;
+	sqe->fd = dirfd;
+	sqe->addr = reinterpret_cast<uint64_t>(path);
+	sqe->len = mask;
+	sqe->off = reinterpret_cast<uint64_t>(buf);
+	sqe->statx_flags = flags;
+}
+
+int IoRing::submit(unsigned int wait_nr)
+{
+	while (true) {
+		int ret = syscall(__NR_io_uring_enter,
+						  ring_fd_,
+						  to_submit_,
+						  wait_nr,
+						  wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0,
+						  nullptr,
+						  0);
+		if (ret >= 0) {
+			to_submit_ -= std::min<unsigned int>(ret, to_submit_);
+			return 0;
+		}
+		if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+			return -errno;
+		}
+		// EAGAIN/EBUSY: 内核暂时没有资源或 CQ 满, 先收割已完成的再重试
+		reap();
+	}
+}
+
+void IoRing::reap()
+{
+	unsigned int head = *cq_head_;
+	unsigned int tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+	while (head != tail) {
+		const struct io_uring_cqe& cqe = cqes_[head & cq_mask_];
+		uint32_t slot = static_cast<uint32_t>(cqe.user_data);
+		int32_t res = cqe.res;
+		head++;
+		__atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+		Callback callback = std::move(callbacks_[slot]);
+		callbacks_[slot] = nullptr;
+		free_slots_.push_back(slot);
+		inflight_--;
+		if (callback) {
+			callback(res);
+		}
+		tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+	}
+}
+
+int IoRing::wait_all()
+{
+	if (ring_fd_ < 0) {
+		return -ECANCELED;
+	}
+	while (inflight_ > 0) {
+		int ret = submit(1);
+		if (ret < 0) {
+			fail_all(ret);
+			return ret;
+		}
+		reap();
+	}
+	return 0;
+}
+
+#else
+
+IoRing::~IoRing()
+{
+}
+
+int IoRing::init(unsigned int depth)
+{
+	(void)depth;
+	return -ENOSYS;
+}
+
+bool IoRing::ready() const
+{
+	return false;
+}
+
+void IoRing::openat(int dirfd, const char* path, int flags, mode_t mode, Callback callback)
+{
+	if (callback) {
+		callback(-ENOSYS);
+	}
+}
+
+void IoRing::readv(int fd, const struct iovec* iov, int count, uint64_t offset, Callback callback)
+{
+	if (callback) {
+		callback(-ENOSYS);
+	}
+}
+
+void IoRing::writev(int fd, const struct iovec* iov, int count, uint64_t offset, Callback callback)
+{
+	if (callback) {
+		callback(-ENOSYS);
+	}
+}
+
+void IoRing::fsync(int fd, bool datasync, Callback callback)
+{
+	if (callback) {
+		callback(-ENOSYS);
+	}
+}
+
+void IoRing::close(int fd, Callback callback)
+{
+	if (callback) {
+		callback(-ENOSYS);
+	}
+}
+
+void IoRing::statx(int dirfd, const char* path, int flags, unsigned int mask, struct statx* buf, Callback callback)
+{
+	if (callback) {
+		callback(-ENOSYS);
+	}
+}
+
+int IoRing::wait_all()
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+// 基于 io_uring 的批量文件 I/O, 直接使用系统调用, 不依赖 liburing
+// 请求先放进提交队列, 在途请求达到队列深度或调用 wait_all 时才一次性提交给内核
+// 编译时没有 io_uring 头文件(未定义 MEMFS_HAVE_IO_URING)或内核不支持时 init 失败, 调用方应退回普通系统调用
+// 不加锁, 每个线程使用自己的 IoRing
+class IoRing
+{
+  public:
+	// res 为对应系统调用的返回值, 失败时为 -errno
+	using Callback = std::function<void(int32_t res)>;
+	IoRing() = default;
+	~IoRing();
+	IoRing(const IoRing&) = delete;
+	IoRing& operator=(const IoRing&) = delete;
+	// 成功返回 0, 失败返回 -errno
+	int init(unsigned int depth);
+	bool ready() const;
+	// 以下请求的参数(路径, iovec)在完成前必须保持有效
+	void openat(int dirfd, const char* path, int flags, mode_t mode, Callback callback);
+	void readv(int fd, const struct iovec* iov, int count, uint64_t offset, Callback callback);
+	void writev(int fd, const struct iovec* iov, int count, uint64_t offset, Callback callback);
+	void fsync(int fd, bool datasync, Callback callback);
+	void close(int fd, Callback callback);
+	void statx(int dirfd, const char* path, int flags, unsigned int mask, struct statx* buf, Callback callback);
+	// 提交所有请求并等待全部完成, 成功返回 0, io_uring_enter 失败返回 -errno
+	// 失败后 ring 不再可用: 未完成的请求都以该错误码调用 callback 后关闭 ring, ready() 返回 false,
+	// 之后的请求立即以 -ECANCELED 结束, 调用者应退回普通系统调用(已提交的 close 可能没有执行, 需要自己关闭 fd)
+	int wait_all();
+
+  private:
+	// 队列满且提交失败时按 wait_all 失败处理; ring 不可用时直接以错误码调用 callback 并返回 nullptr
+	struct io_uring_sqe* get_sqe(Callback callback);
+	// 以 err 结束所有未完成的请求并关闭 ring
+	void fail_all(int err);
+	void destroy();
+	int submit(unsigned int wait_nr);
+	void reap();
+	int ring_fd_ = -1;
+	unsigned int depth_ = 0;
+	unsigned int to_submit_ = 0;
+	unsigned int inflight_ = 0;
+	// 映射的 SQ/CQ 环和 SQE 数组
+	void* sq_ring_ = nullptr;
+	size_t sq_ring_size_ = 0;
+	void* cq_ring_ = nullptr;
+	size_t cq_ring_size_ = 0;
+	struct io_uring_sqe* sqes_ = nullptr;
+	size_t sqes_size_ = 0;
+	unsigned int* sq_head_ = nullptr;
+	unsigned int* sq_tail_ = nullptr;
+	unsigned int sq_mask_ = 0;
+	unsigned int sq_entries_ = 0;
+	unsigned int* sq_array_ = nullptr;
+	unsigned int* cq_head_ = nullptr;
+	unsigned int* cq_tail_ = nullptr;
+	unsigned int cq_mask_ = 0;
+	struct io_uring_cqe* cqes_ = nullptr;
+	// user_data 是 callbacks_ 的下标, 空闲下标放在 free_slots_
+	std::vector<Callback> callbacks_;
+	std::vector<uint32_t> free_slots_;
+};
+
+// iov[first, first + count) 对应文件中从 offset 开始连续的 len 字节, 一次 preadv/pwritev 或一个 SQE 的参数
+struct IoSpan {
+	size_t first;
+	int count;
+	uint64_t offset;
+	size_t len;
+};
+
+// 把 iov[first, iov.size()) (对应文件中从 offset 开始的连续区间)按 IOV_MAX 切分后追加到 spans
+inline void split_iov(const std::vector<struct iovec>& iov, size_t first, uint64_t offset, std::vector<IoSpan>& spans)
+{
+	while (first < iov.size()) {
+		IoSpan span = {first, 0, offset, 0};
+		for (; first < iov.size() && span.count < IOV_MAX; first++, span.count++) {
+			span.len += iov[first].iov_len;
+		}
+		offset += span.len;
+		spans.push_back(span);
+	}
+}
+#endif
@@ -0,0 +1,163 @@
+#include "lz_codec.h"
+
+#include <cstdint>
+#include <cstring>
+
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t MAX_DISTANCE = 65535;
+static constexpr uint32_t HASH_BITS = 12;
+
+static uint32_t load32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t hash4(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+static uint8_t* put_length(uint8_t* op, size_t v)
+{
+	for (v -= 15; v >= 255; v -= 255) {
+		*op++ = 255;
+	}
+	*op++ = static_cast<uint8_t>(v);
+	return op;
+}
+
+// 输出一个序列, match_len 为 0 表示最后一个只有字面量的序列; 空间不够时返回 nullptr
+static uint8_t* put_sequence(uint8_t* op,
+							 uint8_t* op_end,
+							 const uint8_t* literal,
+							 size_t literal_len,
+							 size_t distance,
+							 size_t match_len)
+{
+	// token, 两段扩展长度和距离最多占 literal_len / 255 + match_len / 255 + 5 字节
+	if (static_cast<size_t>(op_end - op) < literal_len + literal_len / 255 + match_len / 255 + 5) {
+		return nullptr;
+	}
+	size_t match_code = match_len == 0 ? 0 : match_len - MIN_MATCH;
+	uint8_t* token = op++;
+	*token = static_cast<uint8_t>((literal_len >= 15 ? 15 : literal_len) << 4);
+	if (literal_len >= 15) {
+		op = put_length(op, literal_len);
+	}
+	memcpy(op, literal, literal_len);
+	op += literal_len;
+	if (match_len == 0) {
+		return op;
+	}
+	*op++ = static_cast<uint8_t>(distance);
+	*op++ = static_cast<uint8_t>(distance >> 8);
+	*token |= static_cast<uint8_t>(match_code >= 15 ? 15 : match_code);
+	if (match_code >= 15) {
+		op = put_length(op, match_code);
+	}
+	return op;
+}
+
+size_t lz_compress(const char* src, size_t len, char* dst, size_t cap)
+{
+	const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+	uint8_t* op = reinterpret_cast<uint8_t*>(dst);
+	uint8_t* op_end = op + cap;
+	// 块不超过 64KiB, 位置用 16 位保存; 表项为 0 的候选位置会被字节比较排除
+	uint16_t table[1U << HASH_BITS];
+	memset(table, 0, sizeof(table));
+	size_t anchor = 0;
+	size_t pos = 0;
+	while (pos + MIN_MATCH <= len) {
+		uint32_t seq = load32(in + pos);
+		uint32_t h = hash4(seq);
+		size_t candidate = table[h];
+		table[h] = static_cast<uint16_t>(pos);
+		if (candidate >= pos || pos - candidate > MAX_DISTANCE || load32(in + candidate) != seq) {
+			// 连续找不到匹配时加大步长, 不可压缩的数据很快扫完
+			pos += 1 + ((pos - anchor) >> 6);
+			continue;
+		}
+		size_t match_len = MIN_MATCH;
+		while (pos + match_len < len && in[candidate + match_len] == in[pos + match_len]) {
+			match_len++;
+		}
+		op = put_sequence(op, op_end, in + anchor, pos - anchor, pos - candidate, match_len);
+		if (op == nullptr) {
+			return 0;
+		}
+		pos += match_len;
+		anchor = pos;
+	}
+	op = put_sequence(op, op_end, in + anchor, len - anchor, 0, 0);
+	if (op == nullptr) {
+		return 0;
+	}
+	return op - reinterpret_cast<uint8_t*>(dst);
+}
+
+// 读扩展长度, 越界时返回 false
+static bool get_length(const uint8_t*& ip, const uint8_t* ip_end, size_t& v)
+{
+	uint8_t b;
+	do {
+		if (ip >= ip_end) {
+			return false;
+		}
+		b = *ip++;
+		v += b;
+	} while (b == 255);
+	return true;
+}
+
+bool lz_decompress(const char* src, size_t len, char* dst, size_t out_len)
+{
+	const uint8_t* ip = reinterpret_cast<const uint8_t*>(src);
+	const uint8_t* ip_end = ip + len;
+	uint8_t* base = reinterpret_cast<uint8_t*>(dst);
+	uint8_t* op = base;
+	uint8_t* op_end = op + out_len;
+	while (ip < ip_end) {
+		uint8_t token = *ip++;
+		size_t literal_len = token >> 4;
+		if (literal_len == 15 && !get_length(ip, ip_end, literal_len)) {
+			return false;
+		}
+		if (literal_len > static_cast<size_t>(ip_end - ip) || literal_len > static_cast<size_t>(op_end - op)) {
+			return false;
+		}
+		memcpy(op, ip, literal_len);
+		op += literal_len;
+		ip += literal_len;
+		if (ip == ip_end) {
+			break;
+		}
+		if (ip_end - ip < 2) {
+			return false;
+		}
+		size_t distance = ip[0] | (ip[1] << 8);
+		ip += 2;
+		size_t match_len = token & 15;
+		if (match_len == 15 && !get_length(ip, ip_end, match_len)) {
+			return false;
+		}
+		match_len += MIN_MATCH;
+		if (distance == 0 || distance > static_cast<size_t>(op - base)
+			|| match_len > static_cast<size_t>(op_end - op)) {
+			return false;
+		}
+		const uint8_t* match = op - distance;
+		if (distance >= match_len) {
+			memcpy(op, match, match_len);
+			op += match_len;
+		} else {
+			// 重叠的匹配(重复模式)逐字节复制
+			for (size_t i = 0; i < match_len; i++) {
+				*op++ = match[i];
+			}
+		}
+	}
+	return op == op_end;
+}
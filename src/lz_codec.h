@@ -0,0 +1,13 @@
+#ifndef LZ_CODEC_H
+#define LZ_CODEC_H
+#include <cstddef>
+
+// 内置的 LZ77 块压缩, 格式同 LZ4 block: 每个序列是 token(高 4 位字面量长度, 低 4 位匹配长度 - 4),
+// 长度为 15 时后接 255 累加的扩展字节, 然后是字面量和 2 字节小端的匹配距离; 最后一个序列只有字面量
+// 一次最多压缩 64KiB(距离用 16 位表示), 用于压缩冷文件的数据块
+
+// 把 [src, src + len) 压缩到 dst, 返回压缩后的长度; 超过 cap 时返回 0
+size_t lz_compress(const char* src, size_t len, char* dst, size_t cap);
+// 解压到 dst, 输出必须正好是 out_len 字节, 数据损坏时返回 false
+bool lz_decompress(const char* src, size_t len, char* dst, size_t out_len);
+#endif
@@ -0,0 +1,1624 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <linux/falloc.h>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "mem_fs.h"
+
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+
+using namespace std;
+
+InodeTable inodes;
+DentryCache dentries;
+HandleTable handles;
+CacheConfig cache_config;
+LoopConfig loop_config;
+IoConfig io_config;
+WriteBackConfig writeback_config;
+ScanConfig scan_config;
+EvictConfig evict_config;
+CompressConfig compress_config;
+DedupConfig dedup_config;
+SnapshotConfig snapshot_config;
+InvalNotifier notifier;
+WriteBack writeback;
+Evictor evictor;
+Compressor compressor;
+std::mutex rename_mutex;
+// 目录被 rename 的次数, 其下所有文件的路径都随之变化
+static std::atomic<uint64_t> dir_renames{0};
+string real_path_perfix;
+
+static int32_t init_local_files_to_fs(const std::string& real_path, const MemoryFilePtr& dir);
+
+string get_real_path(const std::string& path)
+{
+	return real_path_perfix + path;
+}
+
+// 调用者需持有 dir 的读锁或写锁
+static MemoryFilePtr find_child_locked(const MemoryFilePtr& dir, const std::string& name)
+{
+	if (dir->children == nullptr) {
+		return nullptr;
+	}
+	auto it = dir->children->find(name);
+	if (it == dir->children->end()) {
+		return nullptr;
+	}
+	return inodes.get(it->second);
+}
+
+// 先查 dentry 缓存, 未命中时在目录读锁内查找并回填(包括不存在的负向结果)
+MemoryFilePtr lookup_child(const MemoryFilePtr& dir, const std::string& name)
+{
+	uint64_t ino;
+	if (dentries.lookup(dir->ino, name, ino)) {
+		if (ino == DentryCache::NEGATIVE) {
+			return nullptr;
+		}
+		auto file = inodes.get(ino);
+		if (file != nullptr) {
+			return file;
+		}
+	}
+	load_dir(dir);
+	shared_lock<shared_mutex> lock(dir->rw_mutex);
+	auto file = find_child_locked(dir, name);
+	dentries.insert(dir->ino, name, file == nullptr ? DentryCache::NEGATIVE : file->ino);
+	return file;
+}
+
+// 调用者需持有 parent 的写锁
+static void link_child_locked(const MemoryFilePtr& parent, const MemoryFilePtr& file)
+{
+	dentries.invalidate(parent->ino, file->name);
+	file->parent = parent->ino;
+	if (parent->children == nullptr) {
+		parent->children = new ChildMap();
+	}
+	(*parent->children)[file->name] = file->ino;
+}
+
+// 文件从目录树摘除后, target 中的原路径可能被同名新文件回写覆盖, 还没加载的不再加载;
+// 已有的映射仍然有效(回写重建同名文件时先删除再新建, 不会改写原 inode), 有打开的句柄时保留, 否则直接丢弃
+static void detach_backing(const MemoryFilePtr& file)
+{
+	unique_lock<shared_mutex> lock(file->rw_mutex);
+	if (!file->local_path.empty()) {
+		writeback.remove_move(file->local_path, file->ino);
+	}
+	std::string().swap(file->local_path);
+	if (file->load_state != LoadState::LOADED || file->data.mapped_bytes() == 0 || file->open_count > 0) {
+		return;
+	}
+	file->data.clear();
+	file->load_state = LoadState::NOT_LOADED;
+}
+
+// 调用者需持有 parent 的写锁, 内核仍持有 lookup 计数时推迟到 forget 再从 inode 表删除
+static void unlink_child_locked(const MemoryFilePtr& parent, const MemoryFilePtr& file)
+{
+	if (parent->children != nullptr) {
+		parent->children->erase(file->name);
+	}
+	dentries.invalidate(parent->ino, file->name);
+	file->unlinked = true;
+	if (!S_ISDIR(file->mode)) {
+		detach_backing(file);
+	}
+	if ((file->nlookup.fetch_or(NLOOKUP_UNLINKED) & ~NLOOKUP_UNLINKED) == 0) {
+		inodes.erase(file->ino);
+	}
+}
+
+bool hold_inode(const MemoryFilePtr& file)
+{
+	if (file->nlookup.fetch_add(1) == NLOOKUP_UNLINKED) {
+		// 已被删除且已从 inode 表移除, 不能再交给内核
+		file->nlookup.fetch_sub(1);
+		return false;
+	}
+	return true;
+}
+
+void forget_inode(const MemoryFilePtr& file, uint64_t nlookup)
+{
+	if (file->nlookup.fetch_sub(nlookup) - nlookup == NLOOKUP_UNLINKED) {
+		inodes.erase(file->ino);
+	}
+}
+
+uint64_t path_version(const MemoryFilePtr& file)
+{
+	return file->renames + dir_renames;
+}
+
+// 逐级持有父目录的读锁来读取 name, 调用者不能持有任何目录锁
+string get_path_by_file(const MemoryFilePtr& file)
+{
+	std::vector<std::string> names;
+	MemoryFilePtr cur = file;
+	while (cur->ino != InodeTable::ROOT_INO) {
+		uint64_t parent_ino = cur->parent;
+		auto parent = inodes.get(parent_ino);
+		if (parent == nullptr) {
+			break;
+		}
+		shared_lock<shared_mutex> lock(parent->rw_mutex);
+		if (cur->parent != parent_ino) {
+			// 并发 rename 移走了 cur, 重新读取
+			continue;
+		}
+		names.push_back(cur->name);
+		lock.unlock();
+		cur = parent;
+	}
+	if (names.empty()) {
+		return "/";
+	}
+	string path;
+	for (auto it = names.rbegin(); it != names.rend(); ++it) {
+		path += "/" + *it;
+	}
+	return path;
+}
+
+// 第一次访问目录时才从 target 目录加载其子项, 调用者不能持有该目录的锁
+void load_dir(const MemoryFilePtr& dir)
+{
+	if (!S_ISDIR(dir->mode) || real_path_perfix.empty()) {
+		return;
+	}
+	{
+		shared_lock<shared_mutex> lock(dir->rw_mutex);
+		if (dir->is_init) {
+			return;
+		}
+	}
+	unique_lock<shared_mutex> lock(dir->rw_mutex);
+	if (dir->is_init) {
+		return;
+	}
+	dir->is_init = true;
+	if (!dir->local_path.empty()) {
+		init_local_files_to_fs(dir->local_path, dir);
+		std::string().swap(dir->local_path);
+	}
+}
+
+MemoryFilePtr get_file_by_path(const std::string& path)
+{
+	MemoryFilePtr file = inodes.get(InodeTable::ROOT_INO);
+	size_t pos = 0;
+	while (file != nullptr) {
+		while (pos < path.length() && path[pos] == '/') {
+			pos++;
+		}
+		if (pos >= path.length()) {
+			break;
+		}
+		size_t end = path.find('/', pos);
+		if (end == std::string::npos) {
+			end = path.length();
+		}
+		if (!S_ISDIR(file->mode)) {
+			return nullptr;
+		}
+		file = lookup_child(file, path.substr(pos, end - pos));
+		pos = end;
+	}
+	return file;
+}
+
+// 调用者需持有 rename_mutex, 此时目录之间的祖先关系不会改变
+static bool is_ancestor(const MemoryFilePtr& ancestor, const MemoryFilePtr& file)
+{
+	MemoryFilePtr cur = file;
+	while (cur != nullptr) {
+		if (cur->ino == ancestor->ino) {
+			return true;
+		}
+		if (cur->ino == InodeTable::ROOT_INO) {
+			return false;
+		}
+		cur = inodes.get(cur->parent);
+	}
+	return false;
+}
+
+// 增删子项前确认父目录可用并已加载
+static int32_t prepare_parent_dir(const MemoryFilePtr& parent)
+{
+	if (parent == nullptr) {
+		return -ENOENT;
+	}
+	if (!S_ISDIR(parent->mode)) {
+		return -ENOTDIR;
+	}
+	load_dir(parent);
+	return 0;
+}
+
+void stat_by_file(const MemoryFilePtr& file, struct stat* stbuf)
+{
+	memset(stbuf, 0, sizeof(struct stat));
+	stbuf->st_ino = file->ino;
+	stbuf->st_size = file->size;
+	stbuf->st_mode = file->mode;
+	stbuf->st_ctime = file->ctime;
+	stbuf->st_mtime = file->mtime;
+	stbuf->st_atime = file->atime;
+	stbuf->st_nlink = S_ISDIR(stbuf->st_mode) ? 2 : 1;
+	stbuf->st_size = S_ISDIR(stbuf->st_mode) ? 4096 : file->size;
+	// 按实际分配的块(压缩块按压缩后的大小)加上映射的部分计算, 空洞不占空间
+	stbuf->st_blocks = S_ISDIR(stbuf->st_mode)
+						   ? 8
+						   : (file->data.stored_bytes() + 511) / 512 + (file->data.mapped_bytes() + 511) / 512;
+}
+
+IoRing* thread_io_ring()
+{
+	thread_local IoRing ring;
+	thread_local bool tried = false;
+	if (!io_config.io_uring) {
+		return nullptr;
+	}
+	if (!tried) {
+		tried = true;
+		int ret = ring.init(io_config.uring_depth);
+		if (ret != 0) {
+			LOGE("io_uring unavailable, ret is %d, fall back to blocking io\n", ret);
+		}
+	}
+	return ring.ready() ? &ring : nullptr;
+}
+
+// 把本地文件中有数据的区段映射进 data, iov 和 spans 描述要读入的位置; 本地文件里的空洞在内存中同样保持为空洞
+static void map_data_regions(int fd,
+							 uint64_t size,
+							 FileData& data,
+							 std::vector<struct iovec>& iov,
+							 std::vector<IoSpan>& spans)
+{
+	off_t start = 0;
+	while (static_cast<uint64_t>(start) < size) {
+		off_t data_start = lseek(fd, start, SEEK_DATA);
+		if (data_start < 0 && errno == ENXIO) {
+			break;
+		}
+		// 不支持 SEEK_DATA 的文件系统把剩下的部分整体当作数据
+		off_t end = data_start < 0 ? -1 : lseek(fd, data_start, SEEK_HOLE);
+		start = data_start < 0 ? start : data_start;
+		if (end < 0 || static_cast<uint64_t>(end) > size) {
+			end = size;
+		}
+		size_t first = iov.size();
+		data.map_write(start, end - start, iov);
+		split_iov(iov, first, start, spans);
+		start = end;
+	}
+}
+
+// 按扫描时记录的 size 读入, 成功返回 0, 打不开或读取出错时返回 -errno
+static int32_t read_file_to_memory(const std::string& path, uint64_t size, FileData& data)
+{
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		int32_t ret = -errno;
+		LOGE("Failed to open file: %s\n", path.c_str());
+		return ret;
+	}
+	LOGI("read file, file size: %zu\n", size);
+	std::vector<struct iovec> iov;
+	std::vector<IoSpan> spans;
+	map_data_regions(fd, size, data, iov, spans);
+	int32_t ret = 0;
+	for (const auto& span : spans) {
+		ssize_t n;
+		do {
+			n = preadv(fd, iov.data() + span.first, span.count, span.offset);
+		} while (n < 0 && errno == EINTR);
+		if (n < 0) {
+			ret = -errno;
+			LOGE("Failed to read file: %s, errno is %d\n", path.c_str(), errno);
+			break;
+		}
+		if (n != static_cast<ssize_t>(span.len)) {
+			// 读取过程中本地文件被截断, 没读到的部分保持为零
+			LOGE("Short read of file: %s, %zd of %zu bytes\n", path.c_str(), n, span.len);
+			break;
+		}
+	}
+	close(fd);
+	return ret;
+}
+
+// 把本地文件私有只读映射进 data, 不读取数据; 映射长度取 size 和文件当前大小中较小的一个, 超出部分读到零
+// 文件系统不支持 mmap 时退回读入内存
+static int32_t map_file_to_memory(const std::string& path, uint64_t size, FileData& data)
+{
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		int32_t ret = -errno;
+		LOGE("Failed to open file: %s\n", path.c_str());
+		return ret;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		int32_t ret = -errno;
+		close(fd);
+		return ret;
+	}
+	uint64_t len = std::min<uint64_t>(size, st.st_size);
+	void* base = len == 0 ? nullptr : mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		LOGE("mmap %s fail, errno is %d, read it into memory\n", path.c_str(), errno);
+		return read_file_to_memory(path, size, data);
+	}
+	if (base != nullptr) {
+		data.attach_mapping(static_cast<const char*>(base), len, len);
+	}
+	return 0;
+}
+
+// 内容先读入 data, 完成后再在文件锁内换入 MemoryFile
+struct LoadJob {
+	std::string path;
+	uint64_t size = 0;
+	FileData data;
+	int32_t ret = 0;
+	int fd = -1;
+	bool failed = false;
+	std::vector<struct iovec> iov;
+	std::vector<IoSpan> spans;
+};
+
+// 一批文件一起读入: 有 io_uring 时 open, read, close 分别批量提交, 失败的文件再逐个用阻塞 I/O 重读
+static void read_files_to_memory(std::vector<LoadJob>& jobs)
+{
+	IoRing* ring = thread_io_ring();
+	if (ring == nullptr) {
+		for (auto& job : jobs) {
+			job.ret = read_file_to_memory(job.path, job.size, job.data);
+		}
+		return;
+	}
+	for (auto& job : jobs) {
+		ring->openat(AT_FDCWD, job.path.c_str(), O_RDONLY | O_CLOEXEC, 0, [&job](int32_t res) { job.fd = res; });
+	}
+	// ring 出错时所有未完成的请求都以错误结束, 之后的请求立即失败, 这些文件都走下面的阻塞重读
+	int32_t ret = ring->wait_all();
+	for (auto& job : jobs) {
+		if (job.fd < 0) {
+			continue;
+		}
+		map_data_regions(job.fd, job.size, job.data, job.iov, job.spans);
+		for (const auto& span : job.spans) {
+			size_t len = span.len;
+			ring->readv(job.fd, job.iov.data() + span.first, span.count, span.offset, [&job, len](int32_t res) {
+				if (res < 0 || static_cast<size_t>(res) != len) {
+					job.failed = true;
+				}
+			});
+		}
+	}
+	ret = ret == 0 ? ring->wait_all() : ret;
+	if (ret != 0) {
+		LOGE("io_uring fail, ret is %d, load files with blocking io\n", ret);
+	}
+	for (auto& job : jobs) {
+		if (job.fd >= 0 && ret == 0) {
+			ring->close(job.fd, nullptr);
+		} else if (job.fd >= 0) {
+			close(job.fd);
+		}
+		if (job.fd < 0 || job.failed) {
+			LOGE("io_uring read %s fail, retry with blocking io\n", job.path.c_str());
+			job.ret = read_file_to_memory(job.path, job.size, job.data);
+		}
+	}
+	if (ret == 0 && ring->wait_all() != 0) {
+		LOGE("io_uring close fail, some fds may leak\n");
+	}
+}
+
+static std::mutex load_mutex;
+static std::condition_variable load_cond;
+
+// 读入 files 中还没加载的文件内容, 其他线程正在加载的文件等待其完成
+// 有文件读取失败时返回 -EIO, 失败的文件回到 NOT_LOADED, 下次访问时重试; 已被删除的文件返回 -ENOENT
+static int32_t load_files(const std::vector<MemoryFilePtr>& files)
+{
+	int32_t ret = 0;
+	std::vector<MemoryFilePtr> claimed;
+	std::vector<MemoryFilePtr> waiting;
+	for (const auto& file : files) {
+		if (file->load_state == LoadState::LOADED) {
+			continue;
+		}
+		unique_lock<shared_mutex> lock(file->rw_mutex);
+		if (file->load_state == LoadState::NOT_LOADED && file->local_path.empty()) {
+			// 已被删除
+			ret = -ENOENT;
+		} else if (file->load_state == LoadState::NOT_LOADED) {
+			file->load_state = LoadState::LOADING;
+			claimed.push_back(file);
+		} else if (file->load_state == LoadState::LOADING) {
+			waiting.push_back(file);
+		}
+	}
+
+	if (!claimed.empty()) {
+		// 加载期间内容和大小不会变化: 写需要先 open, 截断会等待加载完成
+		std::vector<LoadJob> jobs(claimed.size());
+		for (size_t i = 0; i < claimed.size(); i++) {
+			shared_lock<shared_mutex> lock(claimed[i]->rw_mutex);
+			jobs[i].path = claimed[i]->local_path;
+			jobs[i].size = claimed[i]->size;
+		}
+		if (io_config.mmap) {
+			for (auto& job : jobs) {
+				job.ret = map_file_to_memory(job.path, job.size, job.data);
+			}
+		} else {
+			read_files_to_memory(jobs);
+		}
+		for (size_t i = 0; i < claimed.size(); i++) {
+			unique_lock<shared_mutex> lock(claimed[i]->rw_mutex);
+			if (claimed[i]->local_path.empty()) {
+				// 加载期间被删除, 内容丢弃
+				claimed[i]->load_state = LoadState::NOT_LOADED;
+				ret = ret == 0 ? -ENOENT : ret;
+				continue;
+			}
+			if (jobs[i].ret != 0) {
+				LOGE("load file %s fail, ret is %d\n", jobs[i].path.c_str(), jobs[i].ret);
+				claimed[i]->load_state = LoadState::NOT_LOADED;
+				ret = ret == 0 ? -EIO : ret;
+				continue;
+			}
+			claimed[i]->data.swap(jobs[i].data);
+			claimed[i]->load_state = LoadState::LOADED;
+			if (claimed[i]->evicted) {
+				claimed[i]->evicted = false;
+				evictor.record_reload();
+			}
+		}
+		evictor.check();
+		// 状态在文件锁内修改, 通知前取 load_mutex, 保证等待者检查状态后不会错过通知
+		{
+			lock_guard<std::mutex> lock(load_mutex);
+		}
+		load_cond.notify_all();
+	}
+
+	unique_lock<std::mutex> lock(load_mutex);
+	for (const auto& file : waiting) {
+		load_cond.wait(lock, [&file]() { return file->load_state != LoadState::LOADING; });
+		if (file->load_state != LoadState::LOADED) {
+			ret = ret == 0 ? -EIO : ret;
+		}
+	}
+	return ret;
+}
+
+int32_t load_file(const MemoryFilePtr& file)
+{
+	if (file->load_state == LoadState::LOADED) {
+		return 0;
+	}
+	return load_files({file});
+}
+
+// 目录中的一项, 名字来自 getdents64, 属性来自 statx
+struct ScanEntry {
+	std::string name;
+	struct statx stx;
+	int32_t ret = 0;
+};
+
+static constexpr unsigned int SCAN_STATX_MASK =
+	STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_ATIME | STATX_MTIME | STATX_CTIME;
+
+// 用 getdents64 读出 dirfd 下的所有目录项(跳过 . 和 ..), 每次系统调用读 64KB
+static int32_t read_dir_entries(int dirfd, std::vector<ScanEntry>& entries)
+{
+	thread_local std::vector<char> buf(64 * 1024);
+	while (true) {
+		ssize_t n = getdents64(dirfd, buf.data(), buf.size());
+		if (n < 0) {
+			return -errno;
+		}
+		if (n == 0) {
+			return 0;
+		}
+		for (ssize_t pos = 0; pos < n;) {
+			auto* dent = reinterpret_cast<struct dirent64*>(buf.data() + pos);
+			pos += dent->d_reclen;
+			if (strcmp(dent->d_name, ".") == 0 || strcmp(dent->d_name, "..") == 0) {
+				continue;
+			}
+			entries.emplace_back();
+			entries.back().name = dent->d_name;
+		}
+	}
+}
+
+// 有 io_uring 时一个目录的 statx 一起批量提交, 失败的项(例如内核不支持 IORING_OP_STATX)再逐个重试
+static void stat_dir_entries(int dirfd, std::vector<ScanEntry>& entries)
+{
+	IoRing* ring = thread_io_ring();
+	if (ring != nullptr) {
+		for (auto& entry : entries) {
+			ring->statx(dirfd,
+						entry.name.c_str(),
+						AT_STATX_DONT_SYNC,
+						SCAN_STATX_MASK,
+						&entry.stx,
+						[&entry](int32_t res) { entry.ret = res; });
+		}
+		if (ring->wait_all() != 0) {
+			ring = nullptr;
+		}
+	}
+	for (auto& entry : entries) {
+		if (ring != nullptr && entry.ret == 0) {
+			continue;
+		}
+		entry.ret = statx(dirfd, entry.name.c_str(), AT_STATX_DONT_SYNC, SCAN_STATX_MASK, &entry.stx) == 0 ? 0 : -errno;
+	}
+}
+
+// 调用者需持有 dir 的写锁
+static int32_t init_local_files_to_fs(const std::string& real_path, const MemoryFilePtr& dir)
+{
+	LOGD("init local file to fs, dir ino is %lu, real path is %s\n", dir->ino, real_path.c_str());
+	int dirfd = open(real_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd < 0) {
+		int32_t ret = -errno;
+		LOGE("Failed to open local dir: %s, ret is %d\n", real_path.c_str(), ret);
+		return ret;
+	}
+	std::vector<ScanEntry> entries;
+	int32_t ret = read_dir_entries(dirfd, entries);
+	if (ret == 0) {
+		stat_dir_entries(dirfd, entries);
+	}
+	close(dirfd);
+	if (ret != 0) {
+		LOGE("Failed to read local dir: %s, ret is %d\n", real_path.c_str(), ret);
+		return ret;
+	}
+	for (const auto& entry : entries) {
+		if (entry.ret != 0) {
+			// 扫描期间被删除等情况, 跳过该项
+			LOGE("Failed to stat %s/%s, ret is %d\n", real_path.c_str(), entry.name.c_str(), entry.ret);
+			continue;
+		}
+		MemoryFilePtr file_ptr = make_memory_file();
+		file_ptr->name = entry.name;
+		file_ptr->mode = entry.stx.stx_mode;
+		file_ptr->mtime = entry.stx.stx_mtime.tv_sec;
+		file_ptr->ctime = entry.stx.stx_ctime.tv_sec;
+		file_ptr->atime = entry.stx.stx_atime.tv_sec;
+		file_ptr->local_path = real_path + "/" + entry.name;
+		if (!S_ISDIR(file_ptr->mode)) {
+			file_ptr->size = entry.stx.stx_size;
+			if (S_ISREG(file_ptr->mode)) {
+				file_ptr->load_state = LoadState::NOT_LOADED;
+			}
+		} else {
+			file_ptr->size = 4096;
+		}
+		inodes.insert(file_ptr);
+		link_child_locked(dir, file_ptr);
+		LOGD("init file to fs success, file ino is %lu\n", file_ptr->ino);
+	}
+	return 0;
+}
+
+// path 为挂载点内以 / 开头的路径
+static bool match_preload(const std::string& path)
+{
+	for (const auto& pattern : scan_config.preload) {
+		if (fnmatch(pattern.c_str(), path.c_str(), FNM_PATHNAME) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+struct ScanTask {
+	MemoryFilePtr dir;
+	std::string path;
+	// 祖先目录匹配了 preload, 子树下的文件都要读入
+	bool preload = false;
+};
+
+// 并行扫描的共享状态, pending 为排队和正在处理的目录数, 降为 0 时扫描结束
+struct ScanState {
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<ScanTask> tasks;
+	uint64_t pending = 0;
+	std::atomic<uint64_t> dirs{0};
+	std::atomic<uint64_t> files{0};
+	std::atomic<uint64_t> bytes{0};
+	std::atomic<uint64_t> preload_files{0};
+	std::atomic<uint64_t> preload_bytes{0};
+};
+
+// 加载一个目录的子项, 子目录放回队列, 匹配 preload 的文件按目录批量读入
+static void scan_dir(ScanState& state, const ScanTask& task)
+{
+	load_dir(task.dir);
+	std::vector<ScanTask> subdirs;
+	std::vector<MemoryFilePtr> preload;
+	uint64_t files = 0;
+	uint64_t bytes = 0;
+	{
+		shared_lock<shared_mutex> lock(task.dir->rw_mutex);
+		if (task.dir->children != nullptr) {
+			for (const auto& child : *task.dir->children) {
+				auto file = inodes.get(child.second);
+				if (file == nullptr) {
+					continue;
+				}
+				std::string path = task.path + "/" + child.first;
+				bool match = task.preload || match_preload(path);
+				if (S_ISDIR(file->mode)) {
+					subdirs.push_back({file, std::move(path), match});
+					continue;
+				}
+				files++;
+				bytes += file->size;
+				if (match && S_ISREG(file->mode)) {
+					preload.push_back(file);
+				}
+			}
+		}
+	}
+	state.dirs++;
+	state.files += files;
+	state.bytes += bytes;
+	if (!preload.empty()) {
+		load_files(preload);
+		for (const auto& file : preload) {
+			if (file->load_state == LoadState::LOADED) {
+				state.preload_files++;
+				state.preload_bytes += file->size;
+			}
+		}
+	}
+	if (!subdirs.empty()) {
+		lock_guard<std::mutex> lock(state.mutex);
+		state.pending += subdirs.size();
+		for (auto& subdir : subdirs) {
+			state.tasks.push_back(std::move(subdir));
+		}
+		state.cond.notify_all();
+	}
+}
+
+static void scan_worker(ScanState& state)
+{
+	while (true) {
+		ScanTask task;
+		{
+			unique_lock<std::mutex> lock(state.mutex);
+			state.cond.wait(lock, [&state]() { return !state.tasks.empty() || state.pending == 0; });
+			if (state.tasks.empty()) {
+				return;
+			}
+			task = std::move(state.tasks.front());
+			state.tasks.pop_front();
+		}
+		scan_dir(state, task);
+		lock_guard<std::mutex> lock(state.mutex);
+		if (--state.pending == 0) {
+			state.cond.notify_all();
+		}
+	}
+}
+
+// 挂载前用线程池扫描整棵 target 目录树并读入 preload 匹配的文件, 定期输出进度
+static void scan_tree(const MemoryFilePtr& root)
+{
+	if (scan_config.threads == 0 && scan_config.preload.empty()) {
+		return;
+	}
+	unsigned int threads = std::max(1u, scan_config.threads);
+	auto start = std::chrono::steady_clock::now();
+	ScanState state;
+	state.tasks.push_back({root, "", match_preload("/")});
+	state.pending = 1;
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < threads; i++) {
+		workers.emplace_back(scan_worker, std::ref(state));
+	}
+	auto elapsed = [&start]() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	};
+	{
+		unique_lock<std::mutex> lock(state.mutex);
+		while (!state.cond.wait_for(lock, std::chrono::seconds(5), [&state]() { return state.pending == 0; })) {
+			LOGI("scan progress: %lu dirs, %lu files, %lu MB, preloaded %lu files %lu MB, %.1f s\n",
+				 state.dirs.load(),
+				 state.files.load(),
+				 state.bytes.load() >> 20,
+				 state.preload_files.load(),
+				 state.preload_bytes.load() >> 20,
+				 elapsed());
+		}
+	}
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	LOGI("scan finished with %u threads: %lu dirs, %lu files, %lu MB, preloaded %lu files %lu MB, ready in %.2f s\n",
+		 threads,
+		 state.dirs.load(),
+		 state.files.load(),
+		 state.bytes.load() >> 20,
+		 state.preload_files.load(),
+		 state.preload_bytes.load() >> 20,
+		 elapsed());
+}
+
+int32_t init_root()
+{
+	if (!snapshot_config.path.empty()) {
+		MemoryFilePtr root = restore_snapshot(snapshot_config.path);
+		if (root != nullptr) {
+			// 只扫描镜像中没有加载的目录和 preload 匹配但没有内容的文件
+			scan_tree(root);
+			return 0;
+		}
+	}
+	MemoryFilePtr root = make_memory_file();
+	root->name = "/";
+	root->mode = S_IFDIR | 0755;
+	root->mtime = time(nullptr);
+	root->ctime = root->mtime;
+	root->children = nullptr;
+	root->local_path = real_path_perfix;
+	inodes.insert(root);
+	if (real_path_perfix.empty()) {
+		return 0;
+	}
+	load_dir(root);
+	scan_tree(root);
+	return 0;
+}
+
+int32_t do_mkdir(const MemoryFilePtr& parent, const std::string& name, mode_t mode, MemoryFilePtr& new_dir)
+{
+	int32_t ret = prepare_parent_dir(parent);
+	if (ret != 0) {
+		return ret;
+	}
+	new_dir = make_memory_file();
+	new_dir->name = name;
+	new_dir->mode = S_IFDIR | mode;
+	new_dir->size = 4096;
+	new_dir->mtime = time(nullptr);
+	new_dir->ctime = new_dir->mtime;
+	new_dir->children = nullptr;
+	new_dir->is_init = true;
+	unique_lock<std::shared_mutex> lock(parent->rw_mutex);
+	if (parent->unlinked) {
+		return -ENOENT;
+	}
+	if (find_child_locked(parent, name) != nullptr) {
+		return -EEXIST;
+	}
+	inodes.insert(new_dir);
+	link_child_locked(parent, new_dir);
+	return 0;
+}
+
+// 同名文件已存在时直接返回该文件
+int32_t do_create(const MemoryFilePtr& parent, const std::string& name, mode_t mode, MemoryFilePtr& file)
+{
+	int32_t ret = prepare_parent_dir(parent);
+	if (ret != 0) {
+		return ret;
+	}
+	unique_lock<std::shared_mutex> lock(parent->rw_mutex);
+	if (parent->unlinked) {
+		return -ENOENT;
+	}
+	file = find_child_locked(parent, name);
+	if (file != nullptr) {
+		return 0;
+	}
+	file = make_memory_file();
+	file->name = name;
+	file->mode = S_IFREG | mode;
+	file->ctime = time(nullptr);
+	file->mtime = file->ctime;
+	file->children = nullptr;
+	// target 中可能有同名的旧文件, 第一次回写时先截断
+	file->shrink_size = 0;
+	inodes.insert(file);
+	link_child_locked(parent, file);
+	return 0;
+}
+
+int32_t do_unlink(const MemoryFilePtr& parent, const std::string& name)
+{
+	int32_t ret = prepare_parent_dir(parent);
+	if (ret != 0) {
+		return ret;
+	}
+	unique_lock<std::shared_mutex> lock(parent->rw_mutex);
+	auto file = find_child_locked(parent, name);
+	if (file == nullptr) {
+		return -ENOENT;
+	}
+	if (S_ISDIR(file->mode)) {
+		return -EISDIR;
+	}
+	// 数据随最后一个引用(inode 表或打开的句柄)释放
+	unlink_child_locked(parent, file);
+	notifier.inval_entry(parent->ino, name);
+	return 0;
+}
+
+int32_t do_rmdir(const MemoryFilePtr& parent, const std::string& name)
+{
+	int32_t ret = prepare_parent_dir(parent);
+	if (ret != 0) {
+		return ret;
+	}
+	auto dir = lookup_child(parent, name);
+	if (dir == nullptr) {
+		return -ENOENT;
+	}
+	if (!S_ISDIR(dir->mode)) {
+		return -ENOTDIR;
+	}
+	// 未加载的目录在 target 下可能并不为空
+	load_dir(dir);
+
+	unique_lock<std::shared_mutex> parent_lock(parent->rw_mutex);
+	if (find_child_locked(parent, name) != dir) {
+		return -ENOENT;
+	}
+	unique_lock<std::shared_mutex> dir_lock(dir->rw_mutex);
+	if (dir->children != nullptr && dir->children->size() > 0) {
+		return -ENOTEMPTY;
+	}
+	unlink_child_locked(parent, dir);
+	notifier.inval_entry(parent->ino, name);
+	return 0;
+}
+
+// 检查被替换的目标与源的类型是否兼容
+static int32_t check_rename_target_locked(const MemoryFilePtr& src_file, const MemoryFilePtr& dst_file)
+{
+	if (S_ISDIR(src_file->mode) && !S_ISDIR(dst_file->mode)) {
+		return -ENOTDIR;
+	}
+	if (!S_ISDIR(src_file->mode) && S_ISDIR(dst_file->mode)) {
+		return -EISDIR;
+	}
+	return 0;
+}
+
+// 调用者需持有 file 的写锁
+static void mark_dirty_locked(const MemoryFilePtr& file)
+{
+	if (!file->need_flush) {
+		file->need_flush = true;
+		file->dirty_since = time(nullptr);
+	}
+}
+
+// 文件被 rename 后不读入内容, 只记下 target 中的原文件, 由回写线程 rename 到新路径; 移走之前懒加载仍从原文件读取
+// 目录的 local_path 只供 load_dir 扫描用, 还没扫描的目录移走后仍从原路径扫描. 调用者需持有 file 的写锁
+static void move_backing_locked(const MemoryFilePtr& file)
+{
+	file->renames++;
+	if (!S_ISREG(file->mode) || file->local_path.empty()) {
+		return;
+	}
+	writeback.add_move(file->local_path, file->ino);
+	mark_dirty_locked(file);
+}
+
+int32_t do_rename(const MemoryFilePtr& src_parent,
+				  const std::string& src_name,
+				  const MemoryFilePtr& dst_parent,
+				  const std::string& dst_name,
+				  unsigned int flags)
+{
+	if ((flags & ~(RENAME_NOREPLACE | RENAME_EXCHANGE)) != 0
+		|| ((flags & RENAME_NOREPLACE) && (flags & RENAME_EXCHANGE))) {
+		return -EINVAL;
+	}
+	int32_t ret = prepare_parent_dir(src_parent);
+	if (ret != 0) {
+		return ret;
+	}
+	ret = prepare_parent_dir(dst_parent);
+	if (ret != 0) {
+		return ret;
+	}
+	// 被替换的目录需要先加载, 否则无法判断 target 下它是否为空
+	auto dst_hint = lookup_child(dst_parent, dst_name);
+	if (dst_hint != nullptr) {
+		load_dir(dst_hint);
+	}
+
+	unique_lock<std::mutex> rename_lock(rename_mutex, std::defer_lock);
+	unique_lock<std::shared_mutex> first_lock;
+	unique_lock<std::shared_mutex> second_lock;
+	if (src_parent == dst_parent) {
+		first_lock = unique_lock<std::shared_mutex>(src_parent->rw_mutex);
+	} else {
+		rename_lock.lock();
+		MemoryFilePtr first = src_parent;
+		MemoryFilePtr second = dst_parent;
+		if (is_ancestor(dst_parent, src_parent)
+			|| (!is_ancestor(src_parent, dst_parent) && dst_parent->ino < src_parent->ino)) {
+			std::swap(first, second);
+		}
+		first_lock = unique_lock<std::shared_mutex>(first->rw_mutex);
+		second_lock = unique_lock<std::shared_mutex>(second->rw_mutex);
+	}
+
+	if (src_parent->unlinked || dst_parent->unlinked) {
+		return -ENOENT;
+	}
+	auto src_file = find_child_locked(src_parent, src_name);
+	if (src_file == nullptr) {
+		return -ENOENT;
+	}
+	auto dst_file = find_child_locked(dst_parent, dst_name);
+	if (dst_file == src_file) {
+		return 0;
+	}
+	if (src_parent != dst_parent) {
+		if (S_ISDIR(src_file->mode) && is_ancestor(src_file, dst_parent)) {
+			return -EINVAL;
+		}
+		if (dst_file != nullptr && S_ISDIR(dst_file->mode) && is_ancestor(dst_file, src_parent)) {
+			return (flags & RENAME_EXCHANGE) ? -EINVAL : -ENOTEMPTY;
+		}
+	}
+
+	if (flags & RENAME_EXCHANGE) {
+		if (dst_file == nullptr) {
+			return -ENOENT;
+		}
+		(*src_parent->children)[src_name] = dst_file->ino;
+		(*dst_parent->children)[dst_name] = src_file->ino;
+		dentries.invalidate(src_parent->ino, src_name);
+		dentries.invalidate(dst_parent->ino, dst_name);
+		dst_file->name = src_name;
+		dst_file->parent = src_parent->ino;
+		src_file->name = dst_name;
+		src_file->parent = dst_parent->ino;
+		for (const auto& file : {src_file, dst_file}) {
+			if (S_ISDIR(file->mode)) {
+				dir_renames++;
+			} else {
+				unique_lock<std::shared_mutex> file_lock(file->rw_mutex);
+				move_backing_locked(file);
+			}
+		}
+		notifier.inval_entry(src_parent->ino, src_name);
+		notifier.inval_entry(dst_parent->ino, dst_name);
+		return 0;
+	}
+
+	// 被替换的目标在父目录锁之后加锁, 与 rmdir 的加锁顺序一致
+	unique_lock<std::shared_mutex> dst_lock;
+	if (dst_file != nullptr) {
+		if (flags & RENAME_NOREPLACE) {
+			return -EEXIST;
+		}
+		ret = check_rename_target_locked(src_file, dst_file);
+		if (ret != 0) {
+			return ret;
+		}
+		if (S_ISDIR(dst_file->mode)) {
+			dst_lock = unique_lock<std::shared_mutex>(dst_file->rw_mutex);
+			if (!dst_file->is_init) {
+				return -EBUSY;
+			}
+			if (dst_file->children != nullptr && dst_file->children->size() > 0) {
+				return -ENOTEMPTY;
+			}
+		}
+		unlink_child_locked(dst_parent, dst_file);
+	}
+
+	// 只需把 inode 从旧目录摘下挂到新目录, 子树大小不影响耗时
+	src_parent->children->erase(src_name);
+	dentries.invalidate(src_parent->ino, src_name);
+	src_file->name = dst_name;
+	link_child_locked(dst_parent, src_file);
+	if (S_ISDIR(src_file->mode)) {
+		dir_renames++;
+	} else {
+		unique_lock<std::shared_mutex> file_lock(src_file->rw_mutex);
+		move_backing_locked(src_file);
+	}
+	notifier.inval_entry(src_parent->ino, src_name);
+	notifier.inval_entry(dst_parent->ino, dst_name);
+	return 0;
+}
+
+int32_t do_readdir(const MemoryFilePtr& dir, const DirFiller& filler)
+{
+	if (!S_ISDIR(dir->mode)) {
+		return -ENOTDIR;
+	}
+	load_dir(dir);
+	shared_lock<shared_mutex> lock(dir->rw_mutex);
+	if (dir->children == nullptr) {
+		return 0;
+	}
+	for (const auto& child : *dir->children) {
+		auto file = inodes.get(child.second);
+		if (file == nullptr) {
+			continue;
+		}
+		if (!filler(child.first, file)) {
+			break;
+		}
+	}
+	return 0;
+}
+
+int32_t do_open(const MemoryFilePtr& file, int flags, uint64_t& fh)
+{
+	shared_lock<shared_mutex> lock(file->rw_mutex);
+	struct stat stbuf;
+	stat_by_file(file, &stbuf);
+	lock.unlock();
+
+	int access_mode = flags & O_ACCMODE;
+
+	if (S_IFDIR & (stbuf.st_mode)) {
+		if (access_mode != O_RDONLY) {
+			return -EACCES;
+		}
+		return 0;
+	}
+
+	if (access_mode == O_RDONLY) {
+		if (!(stbuf.st_mode & S_IRUSR)) {
+			return -EACCES;
+		}
+	} else if (access_mode == O_WRONLY || access_mode == O_RDWR) {
+		if (!(stbuf.st_mode & S_IWUSR)) {
+			return -EACCES;
+		}
+	} else if (access_mode == O_RDWR) {
+		if (!(stbuf.st_mode & S_IWUSR) || !(stbuf.st_mode & S_IRUSR)) {
+			return -EACCES;
+		}
+	}
+	bool hit = file->load_state == LoadState::LOADED;
+	// 计数要在内容加载好的状态下增加, 与删除时丢弃映射和淘汰互斥
+	while (true) {
+		int32_t ret = load_file(file);
+		if (ret != 0) {
+			return ret;
+		}
+		shared_lock<shared_mutex> file_lock(file->rw_mutex);
+		if (file->load_state == LoadState::LOADED) {
+			file->open_count++;
+			break;
+		}
+	}
+	touch_file(file);
+	int32_t ret = handles.alloc(file, flags, fh);
+	if (ret != 0) {
+		file->open_count--;
+		LOGE("init fd failed, ret is %d, open count is %zu\n", ret, handles.size());
+		return ret;
+	}
+	evictor.track(file, hit);
+	LOGD("init fd success, fd is %lx\n", fh);
+	return 0;
+}
+
+int32_t do_release(uint64_t fh)
+{
+	Fd* fd = handles.get(fh);
+	MemoryFilePtr file = fd == nullptr ? nullptr : fd->file;
+	bool written = fd != nullptr && (fd->mode & O_ACCMODE) != O_RDONLY;
+	int32_t ret = handles.release(fh);
+	if (ret == 0 && file != nullptr && written && dedup_config.enabled) {
+		// 写入时只去重写满的块, 关闭时补上不满一块的结尾(size 之后是零, 内容相同的文件结尾块也相同)
+		unique_lock<shared_mutex> lock(file->rw_mutex);
+		if (file->size % FileData::CHUNK_SIZE != 0) {
+			file->data.dedup_chunk(file->size / FileData::CHUNK_SIZE);
+		}
+	}
+	if (ret == 0 && file != nullptr) {
+		file->referenced = true;
+		file->open_count--;
+	}
+	return ret;
+}
+
+int32_t do_read_with(uint64_t fh, size_t size, off_t offset, const ReadSender& send)
+{
+	Fd* fd = handles.get(fh);
+	if (fd == nullptr || fd->file == nullptr) {
+		return -EBADF;
+	}
+	MemoryFilePtr file = fd->file;
+	thread_local std::vector<struct iovec> iov;
+	iov.clear();
+	touch_file(file);
+	uint64_t pos = static_cast<uint64_t>(offset);
+	shared_lock<shared_mutex> lock(file->rw_mutex);
+	// 读取范围内有压缩块时先在独占锁下解压
+	while (pos < file->size && file->data.has_compressed(pos, std::min(size, file->size - pos))) {
+		lock.unlock();
+		{
+			unique_lock<shared_mutex> write_lock(file->rw_mutex);
+			if (pos < file->size) {
+				file->data.decompress_range(pos, std::min(size, file->size - pos));
+			}
+			file->compress_done = false;
+		}
+		lock.lock();
+	}
+	if (pos < file->size) {
+		file->data.map_read(pos, std::min(size, file->size - pos), iov);
+	}
+	int32_t ret = send(iov.data(), iov.size());
+	if (ret < 0) {
+		return ret;
+	}
+	lock.unlock();
+	unique_lock<shared_mutex> writeLock(file->rw_mutex);
+	file->offset = offset + ret;
+	return ret;
+}
+
+int32_t do_read(uint64_t fh, char* buf, size_t size, off_t offset)
+{
+	return do_read_with(fh, size, offset, [buf](const struct iovec* iov, int count) {
+		size_t copied = 0;
+		for (int i = 0; i < count; i++) {
+			memcpy(buf + copied, iov[i].iov_base, iov[i].iov_len);
+			copied += iov[i].iov_len;
+		}
+		return static_cast<int32_t>(copied);
+	});
+}
+
+int32_t do_write_with(uint64_t fh, size_t size, off_t offset, const WriteFiller& fill)
+{
+	Fd* fd = handles.get(fh);
+	if (fd == nullptr) {
+		LOGE("write failed, fd is invalid\n");
+		return -EBADF;
+	}
+	MemoryFilePtr file = fd->file;
+	if (file == nullptr) {
+		LOGE("write failed, file is null\n");
+		return -EBADF;
+	}
+	if (!real_path_perfix.empty()) {
+		int ret = writeback.throttle();
+		if (ret != 0) {
+			return ret;
+		}
+		evictor.check();
+	}
+	thread_local std::vector<struct iovec> iov;
+	iov.clear();
+	touch_file(file);
+	// 只分配写入范围内缺失的块, 独占锁的持有时间与写入大小成正比, 与文件大小无关
+	unique_lock<shared_mutex> lock(file->rw_mutex);
+	file->data.map_write(offset, size, iov);
+	ssize_t copied = fill(iov.data(), iov.size());
+	if (copied < 0) {
+		return copied;
+	}
+	if (static_cast<uint64_t>(offset + copied) > file->size) {
+		file->size = offset + copied;
+	}
+	if (dedup_config.enabled) {
+		file->data.dedup_range(offset, copied);
+	}
+	file->dirty.add(offset, offset + copied);
+	mark_dirty_locked(file);
+	file->offset = offset + copied;
+	notifier.inval_inode(file->ino);
+	LOGD("write success, write size is %zd\n", copied);
+	return copied;
+}
+
+int32_t do_write(uint64_t fh, const char* buf, size_t size, off_t offset)
+{
+	return do_write_with(fh, size, offset, [buf](const struct iovec* iov, int count) {
+		size_t copied = 0;
+		for (int i = 0; i < count; i++) {
+			memcpy(iov[i].iov_base, buf + copied, iov[i].iov_len);
+			copied += iov[i].iov_len;
+		}
+		return static_cast<ssize_t>(copied);
+	});
+}
+
+int32_t do_truncate(const MemoryFilePtr& file, off_t size)
+{
+	touch_file(file);
+	unique_lock<std::shared_mutex> lock(file->rw_mutex);
+	while (file->load_state != LoadState::LOADED) {
+		if (size == 0 && file->load_state == LoadState::NOT_LOADED && !file->local_path.empty()) {
+			// 截断为 0 不需要原内容
+			file->load_state = LoadState::LOADED;
+			break;
+		}
+		lock.unlock();
+		int32_t ret = load_file(file);
+		if (ret != 0) {
+			return ret;
+		}
+		lock.lock();
+	}
+	if (static_cast<uint64_t>(size) < file->size) {
+		file->data.truncate(size);
+		file->dirty.truncate(size);
+		file->shrink_size = std::min<uint64_t>(file->shrink_size, size);
+	}
+	if (static_cast<uint64_t>(size) != file->size) {
+		mark_dirty_locked(file);
+	}
+	file->size = size;
+	notifier.inval_inode(file->ino);
+	return 0;
+}
+
+int32_t do_utimens(const MemoryFilePtr& file, const struct timespec ts[2])
+{
+	time_t now = time(nullptr);
+	unique_lock<std::shared_mutex> lock(file->rw_mutex);
+	if (ts[0].tv_nsec != UTIME_OMIT) {
+		file->atime = ts[0].tv_nsec == UTIME_NOW ? now : ts[0].tv_sec;
+	}
+	if (ts[1].tv_nsec != UTIME_OMIT) {
+		file->mtime = ts[1].tv_nsec == UTIME_NOW ? now : ts[1].tv_sec;
+	}
+	return 0;
+}
+
+int32_t do_chmod(const MemoryFilePtr& file, mode_t mode)
+{
+	unique_lock<std::shared_mutex> lock(file->rw_mutex);
+	file->mode = (file->mode & S_IFMT) | (mode & 07777);
+	file->ctime = time(nullptr);
+	return 0;
+}
+
+off_t do_lseek(uint64_t fh, off_t offset, int whence)
+{
+	Fd* fd = handles.get(fh);
+	if (fd == nullptr || fd->file == nullptr) {
+		return -EBADF;
+	}
+	MemoryFilePtr file = fd->file;
+	shared_lock<shared_mutex> readLock(file->rw_mutex);
+	switch (whence) {
+	case SEEK_SET:
+		if (offset < 0) {
+			return -EINVAL;
+		}
+		break;
+	case SEEK_CUR:
+		offset += file->offset;
+		break;
+	case SEEK_END:
+		if (offset + file->size < 0) {
+			return -EINVAL;
+		}
+		offset += file->size;
+		break;
+	case SEEK_DATA:
+	case SEEK_HOLE: {
+		if (offset < 0 || static_cast<uint64_t>(offset) >= file->size) {
+			return -ENXIO;
+		}
+		// 文件末尾视为一个隐含的空洞
+		uint64_t found = whence == SEEK_DATA ? file->data.next_data(offset) : file->data.next_hole(offset);
+		if (found >= file->size) {
+			if (whence == SEEK_DATA) {
+				return -ENXIO;
+			}
+			found = file->size;
+		}
+		offset = found;
+		break;
+	}
+	default:
+		return -EINVAL;
+	}
+	readLock.unlock();
+	unique_lock<shared_mutex> lock(file->rw_mutex);
+	file->offset = offset;
+	return offset;
+}
+
+int32_t do_fsync(uint64_t fh, bool datasync)
+{
+	Fd* fd = handles.get(fh);
+	if (fd == nullptr || fd->file == nullptr) {
+		return -EBADF;
+	}
+	if (real_path_perfix.empty()) {
+		return 0;
+	}
+	return writeback.sync_file(fd->file, datasync);
+}
+
+int32_t do_fallocate(uint64_t fh, int mode, off_t offset, off_t length)
+{
+	Fd* fd = handles.get(fh);
+	if (fd == nullptr || fd->file == nullptr || (fd->mode & O_ACCMODE) == O_RDONLY) {
+		return -EBADF;
+	}
+	if (offset < 0 || length <= 0) {
+		return -EINVAL;
+	}
+	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE)) {
+		return -EOPNOTSUPP;
+	}
+	bool punch_hole = mode & FALLOC_FL_PUNCH_HOLE;
+	bool zero_range = mode & FALLOC_FL_ZERO_RANGE;
+	bool keep_size = mode & FALLOC_FL_KEEP_SIZE;
+	// 与内核一致: 打洞必须带 KEEP_SIZE, 且不能与 ZERO_RANGE 同时使用
+	if (punch_hole && (!keep_size || zero_range)) {
+		return -EINVAL;
+	}
+	if (length > INT64_MAX - offset) {
+		return -EFBIG;
+	}
+	MemoryFilePtr file = fd->file;
+	if (!real_path_perfix.empty()) {
+		int ret = writeback.throttle();
+		if (ret != 0) {
+			return ret;
+		}
+	}
+	touch_file(file);
+	unique_lock<shared_mutex> lock(file->rw_mutex);
+	while (file->load_state != LoadState::LOADED) {
+		lock.unlock();
+		int32_t ret = load_file(file);
+		if (ret != 0) {
+			return ret;
+		}
+		lock.lock();
+	}
+	if (S_ISDIR(file->mode)) {
+		return -EISDIR;
+	}
+	uint64_t end = offset + length;
+	if (punch_hole || zero_range) {
+		file->data.zero_range(offset, length, punch_hole);
+		// 原 size 以内的部分回写时写零, 之后的部分由回写截断补零
+		uint64_t dirty_end = std::min(end, file->size);
+		if (static_cast<uint64_t>(offset) < dirty_end) {
+			file->dirty.add(offset, dirty_end);
+			mark_dirty_locked(file);
+		}
+	} else {
+		file->data.allocate(offset, length);
+	}
+	if (!keep_size && end > file->size) {
+		file->size = end;
+		mark_dirty_locked(file);
+	}
+	notifier.inval_inode(file->ino);
+	lock.unlock();
+	if (!real_path_perfix.empty()) {
+		evictor.check();
+	}
+	return 0;
+}
+
+// 把 src 的 [src_off, src_off + len) 复制到 dst 的 dst_off 处, 整块共享, 返回复制的字节数
+// is_clone 为 true 时是克隆语义: 超出源文件末尾或同一文件内范围重叠时返回 -EINVAL; 否则在源文件末尾截短
+static ssize_t clone_file_range(const MemoryFilePtr& src,
+								uint64_t src_off,
+								const MemoryFilePtr& dst,
+								uint64_t dst_off,
+								uint64_t len,
+								bool is_clone)
+{
+	if (!real_path_perfix.empty()) {
+		int ret = writeback.throttle();
+		if (ret != 0) {
+			return ret;
+		}
+	}
+	touch_file(src);
+	touch_file(dst);
+	// 按 inode 号顺序获取两个文件的写锁
+	MemoryFile* first = src->ino <= dst->ino ? src.get() : dst.get();
+	MemoryFile* second = src->ino <= dst->ino ? dst.get() : src.get();
+	while (true) {
+		int32_t ret = load_file(src);
+		if (ret != 0) {
+			return ret;
+		}
+		unique_lock<shared_mutex> first_lock(first->rw_mutex);
+		unique_lock<shared_mutex> second_lock;
+		if (second != first) {
+			second_lock = unique_lock<shared_mutex>(second->rw_mutex);
+		}
+		if (src->load_state != LoadState::LOADED) {
+			// 加载后又被淘汰了
+			continue;
+		}
+		if (S_ISDIR(src->mode) || S_ISDIR(dst->mode)) {
+			return -EISDIR;
+		}
+		if (src_off >= src->size || len > src->size - src_off) {
+			if (is_clone && (src_off > src->size || len != UINT64_MAX)) {
+				return -EINVAL;
+			}
+			len = src_off >= src->size ? 0 : src->size - src_off;
+		}
+		if (len == 0) {
+			return 0;
+		}
+		if (src == dst && src_off < dst_off + len && dst_off < src_off + len) {
+			return -EINVAL;
+		}
+		// 源范围到文件末尾, 且目标范围之后没有数据时, 结尾不满一块的部分也能共享(两边 size 之后都是零)
+		bool share_tail = src_off + len == src->size && dst_off + len >= dst->size;
+		dst->data.clone_range(src->data, src_off, dst_off, len, share_tail);
+		if (dst_off + len > dst->size) {
+			dst->size = dst_off + len;
+		}
+		dst->dirty.add(dst_off, dst_off + len);
+		mark_dirty_locked(dst);
+		notifier.inval_inode(dst->ino);
+		return len;
+	}
+}
+
+ssize_t do_copy_file_range(uint64_t fh_in, off_t off_in, uint64_t fh_out, off_t off_out, size_t len)
+{
+	Fd* in = handles.get(fh_in);
+	Fd* out = handles.get(fh_out);
+	if (in == nullptr || in->file == nullptr || out == nullptr || out->file == nullptr
+		|| (in->mode & O_ACCMODE) == O_WRONLY || (out->mode & O_ACCMODE) == O_RDONLY) {
+		return -EBADF;
+	}
+	if (off_in < 0 || off_out < 0) {
+		return -EINVAL;
+	}
+	// FUSE 回复中的长度只有 32 位, 一次最多复制不到 4GiB, 调用者会继续复制剩下的部分
+	len = std::min<uint64_t>(len, UINT32_MAX & ~(FileData::CHUNK_SIZE - 1));
+	return clone_file_range(in->file, off_in, out->file, off_out, len, false);
+}
+
+int32_t do_clone_range(uint64_t fh, const struct memfs_clone_range& arg)
+{
+	Fd* out = handles.get(fh);
+	if (out == nullptr || out->file == nullptr || (out->mode & O_ACCMODE) == O_RDONLY) {
+		return -EBADF;
+	}
+	size_t path_len = strnlen(arg.src_path, sizeof(arg.src_path));
+	if (path_len == sizeof(arg.src_path)) {
+		return -ENAMETOOLONG;
+	}
+	std::string path(arg.src_path, path_len);
+	MemoryFilePtr src = get_file_by_path(path[0] == '/' ? path : "/" + path);
+	if (src == nullptr) {
+		return -ENOENT;
+	}
+	uint64_t len = arg.src_length == 0 ? UINT64_MAX : arg.src_length;
+	ssize_t ret = clone_file_range(src, arg.src_offset, out->file, arg.dest_offset, len, true);
+	return ret < 0 ? ret : 0;
+}
+
+int32_t do_snapshot()
+{
+	if (snapshot_config.path.empty()) {
+		return -EINVAL;
+	}
+	return save_snapshot(snapshot_config.path);
+}
+
+void log_cache_stats(LogLevel level)
+{
+	SlabAllocator::Stats memory = SlabAllocator::instance().stats();
+	log_message(level,
+				__FILE__,
+				__LINE__,
+				__func__,
+				"memory: %lu bytes in use, %lu bytes reserved in slabs (%.2f%% used), %lu bytes in large objects\n",
+				memory.in_use,
+				memory.reserved,
+				memory.reserved == 0 ? 0.0 : memory.in_use * 100.0 / memory.reserved,
+				memory.large_in_use);
+
+	uint64_t hits = dentries.hits();
+	uint64_t misses = dentries.misses();
+	uint64_t total = hits + misses;
+	log_message(level,
+				__FILE__,
+				__LINE__,
+				__func__,
+				"dentry cache: %zu entries, %lu hits (%lu negative), %lu misses, hit ratio %.2f%%\n",
+				dentries.size(),
+				hits,
+				dentries.negative_hits(),
+				misses,
+				total == 0 ? 0.0 : hits * 100.0 / total);
+	writeback.log_stats(level);
+	evictor.log_stats(level);
+	compressor.log_stats(level);
+
+	if (dedup_config.enabled) {
+		ChunkStore::Stats dedup = ChunkStore::instance().stats();
+		log_message(level,
+					__FILE__,
+					__LINE__,
+					__func__,
+					"dedup: %lu unique chunks, %lu references (ratio %.2f), %lu bytes saved, %lu chunks hashed in "
+					"%.3f s\n",
+					dedup.chunks,
+					dedup.refs,
+					dedup.chunks == 0 ? 0.0 : static_cast<double>(dedup.refs) / dedup.chunks,
+					dedup.refs > dedup.chunks ? (dedup.refs - dedup.chunks) * FileData::CHUNK_SIZE : 0,
+					dedup.hashed,
+					dedup.hash_ns / 1e9);
+	}
+}
+
+void flush_files(double min_age, bool backoff)
+{
+	LOGD("flush files\n");
+	log_cache_stats(LOG_LEVEL_DEBUG);
+	if (real_path_perfix.empty()) {
+		return;
+	}
+	time_t now = time(nullptr);
+	std::vector<MemoryFilePtr> dirty_files;
+	inodes.for_each([&dirty_files, now, min_age, backoff](const MemoryFilePtr& file) {
+		if (file->need_flush != false && !file->unlinked && difftime(now, file->dirty_since) >= min_age &&
+			(!backoff || file->retry_after <= now)) {
+			dirty_files.push_back(file);
+		}
+	});
+	for (const auto& file : dirty_files) {
+		writeback.schedule(file);
+	}
+}
@@ -0,0 +1,153 @@
+#ifndef MEM_FS_H
+#define MEM_FS_H
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/types.h>
+#include <vector>
+
+#include "mem_fs_file.h"
+#include "inode_table.h"
+#include "handle_table.h"
+#include "dentry_cache.h"
+#include "inval_notifier.h"
+#include "io_ring.h"
+#include "write_back.h"
+#include "evictor.h"
+#include "compressor.h"
+#include "snapshot.h"
+#include "log_utils.h"
+#include "mem_fs_ioctl.h"
+
+/*
+ * 基于 inode 的文件系统核心, 高层(路径)和低层(inode)两种 FUSE 前端共用
+ * 所有 do_* 函数成功返回 0(读写返回字节数), 失败返回 -errno
+ *
+ * 命名空间锁:
+ *  - 每个目录的 children 由该目录的 rw_mutex 保护, create/mkdir/unlink 只锁父目录
+ *  - rmdir 先锁父目录再锁被删除的目录
+ *  - 同目录 rename 只锁该目录; 跨目录 rename 先取 rename_mutex(保证祖先关系不变),
+ *    再锁两个父目录: 祖先在前, 无祖先关系时按 inode 号从小到大
+ *  - InodeTable 和 DentryCache 的分片锁是叶子锁
+ */
+extern InodeTable inodes;
+extern DentryCache dentries;
+extern HandleTable handles;
+extern std::string real_path_perfix;
+
+// 内核缓存目录项, 属性和不存在的目录项的时间(秒)
+// 所有修改都经过本进程, 低层前端在修改路径上通过 notifier 通知内核失效, 因此可以设得较长
+// 只用于低层前端, 高层前端没有失效通知, 使用 libfuse 的默认值
+struct CacheConfig {
+	double entry_timeout = 60.0;
+	double attr_timeout = 60.0;
+	double negative_timeout = 1.0;
+};
+extern CacheConfig cache_config;
+
+// FUSE 多线程循环参数, 为 0 时使用 libfuse 的默认值
+// clone_fd 为每个工作线程单独打开一个 /dev/fuse, 避免所有线程争用同一个请求队列
+struct LoopConfig {
+	unsigned int max_threads = 0;
+	unsigned int max_idle_threads = 0;
+	bool clone_fd = false;
+};
+extern LoopConfig loop_config;
+
+// splice 为 true 时请求内核用 splice 收发读写数据, 读回复直接引用文件存储, 写数据从管道直接读入文件存储
+// io_uring 为 true 时从 target 加载和回写都通过 io_uring 批量提交, uring_depth 为每个线程的队列深度
+// mmap 为 true 时从 target 加载的文件不读入内存, 而是私有只读映射, 数据只在内核页缓存中保留一份,
+// 第一次写某块时才拷贝成私有块. 挂载期间 target 中的文件不能被其他进程截断或修改; memfs 自己从空文件开始重写某个
+// target 文件时先删除再新建, 被删除或 rename 走的文件映射的原 inode 不受影响
+struct IoConfig {
+	bool splice = false;
+	bool io_uring = false;
+	unsigned int uring_depth = 64;
+	bool mmap = false;
+};
+extern IoConfig io_config;
+
+// 挂载前扫描 target 目录树的线程数, 为 0 且没有 preload 时不扫描, 目录在第一次访问时才加载
+// preload 是匹配挂载点内路径(以 / 开头, * 不跨目录)的 glob, 匹配的文件和匹配目录下的所有文件在挂载前读入内存
+struct ScanConfig {
+	unsigned int threads = 0;
+	std::vector<std::string> preload;
+};
+extern ScanConfig scan_config;
+
+extern WriteBackConfig writeback_config;
+extern EvictConfig evict_config;
+extern CompressConfig compress_config;
+extern DedupConfig dedup_config;
+extern SnapshotConfig snapshot_config;
+extern InvalNotifier notifier;
+extern WriteBack writeback;
+extern Evictor evictor;
+extern Compressor compressor;
+
+// 目录项回调, 返回 false 时停止遍历
+using DirFiller = std::function<bool(const std::string& name, const MemoryFilePtr& file)>;
+// 零拷贝读写回调, 在持有文件锁时拿到指向文件存储的 iovec, 回调返回后指针即失效
+// ReadSender 返回发送的字节数, WriteFiller 返回填入的字节数, 失败返回 -errno
+using ReadSender = std::function<int32_t(const struct iovec* iov, int count)>;
+using WriteFiller = std::function<ssize_t(const struct iovec* iov, int count)>;
+
+int32_t init_root();
+std::string get_real_path(const std::string& path);
+std::string get_path_by_file(const MemoryFilePtr& file);
+// 文件或任一目录被 rename 后变化. 先取版本再解析路径, 之后持有文件锁时版本没变, 说明路径仍有效,
+// 或者 rename 正等着该文件的锁, 会在之后登记要移动的原文件
+uint64_t path_version(const MemoryFilePtr& file);
+MemoryFilePtr get_file_by_path(const std::string& path);
+MemoryFilePtr lookup_child(const MemoryFilePtr& dir, const std::string& name);
+void load_dir(const MemoryFilePtr& dir);
+// 读入懒加载文件的内容, 已加载时直接返回 0, 失败返回 -EIO. 调用者不能持有该文件的锁
+int32_t load_file(const MemoryFilePtr& file);
+void stat_by_file(const MemoryFilePtr& file, struct stat* stbuf);
+bool hold_inode(const MemoryFilePtr& file);
+void forget_inode(const MemoryFilePtr& file, uint64_t nlookup);
+
+int32_t do_mkdir(const MemoryFilePtr& parent, const std::string& name, mode_t mode, MemoryFilePtr& new_dir);
+int32_t do_create(const MemoryFilePtr& parent, const std::string& name, mode_t mode, MemoryFilePtr& file);
+int32_t do_unlink(const MemoryFilePtr& parent, const std::string& name);
+int32_t do_rmdir(const MemoryFilePtr& parent, const std::string& name);
+int32_t do_rename(const MemoryFilePtr& src_parent,
+				  const std::string& src_name,
+				  const MemoryFilePtr& dst_parent,
+				  const std::string& dst_name,
+				  unsigned int flags);
+int32_t do_readdir(const MemoryFilePtr& dir, const DirFiller& filler);
+int32_t do_open(const MemoryFilePtr& file, int flags, uint64_t& fh);
+int32_t do_release(uint64_t fh);
+int32_t do_read(uint64_t fh, char* buf, size_t size, off_t offset);
+int32_t do_read_with(uint64_t fh, size_t size, off_t offset, const ReadSender& send);
+int32_t do_write(uint64_t fh, const char* buf, size_t size, off_t offset);
+int32_t do_write_with(uint64_t fh, size_t size, off_t offset, const WriteFiller& fill);
+int32_t do_truncate(const MemoryFilePtr& file, off_t size);
+int32_t do_utimens(const MemoryFilePtr& file, const struct timespec ts[2]);
+int32_t do_chmod(const MemoryFilePtr& file, mode_t mode);
+off_t do_lseek(uint64_t fh, off_t offset, int whence);
+int32_t do_fsync(uint64_t fh, bool datasync);
+// 支持 FALLOC_FL_KEEP_SIZE, FALLOC_FL_PUNCH_HOLE, FALLOC_FL_ZERO_RANGE, 其他标志返回 -EOPNOTSUPP
+// 预分配会立即分配内存块, 之后写入该范围不再分配
+int32_t do_fallocate(uint64_t fh, int mode, off_t offset, off_t length);
+// 与 fh_in 共享数据块, 只修改块指针; 返回复制的字节数, 在源文件末尾截短
+ssize_t do_copy_file_range(uint64_t fh_in, off_t off_in, uint64_t fh_out, off_t off_out, size_t len);
+// MEMFS_IOC_CLONE_RANGE, fh 是目标文件
+int32_t do_clone_range(uint64_t fh, const struct memfs_clone_range& arg);
+// MEMFS_IOC_SNAPSHOT, 没有配置 --snapshot 时返回 -EINVAL
+int32_t do_snapshot();
+
+// 把变脏至少 min_age 秒的文件交给回写引擎, min_age 为 0 时所有脏文件
+// backoff 为 true 时(定时扫描)跳过回写失败后还没到重试时间的文件
+void flush_files(double min_age = 0, bool backoff = false);
+// io_config.io_uring 打开时返回当前线程的 IoRing, 不可用时返回 nullptr, 调用方退回阻塞 I/O
+IoRing* thread_io_ring();
+void log_cache_stats(LogLevel level);
+
+// 两种 FUSE 前端的入口, 参数为去掉 memfs 自身选项后的命令行
+int run_highlevel(int argc, char* argv[]);
+int run_lowlevel(int argc, char* argv[]);
+#endif	// MEM_FS_H
@@ -1,34 +1,107 @@
 #ifndef MEM_FS_FILE_H
 #define MEM_FS_FILE_H
+#include <atomic>
 #include <cstdint>
-#include <set>
+#include <memory>
 #include <shared_mutex>
 #include <stdint.h>
 #include <string>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unordered_map>
 #include <vector>
 
+#include "dirty_extents.h"
+#include "file_data.h"
+#include "slab_allocator.h"
+
+// 目录项: 文件名 -> inode 号
+struct ChildMap
+	: std::unordered_map<std::string,
+						 uint64_t,
+						 std::hash<std::string>,
+						 std::equal_to<std::string>,
+						 SlabStlAllocator<std::pair<const std::string, uint64_t>>>,
+	  SlabObject {
+};
+
+// 从 target 扫描到的普通文件先只有元数据, 第一次 open/truncate 时才读入内容
+// LOADING 时读取在文件锁外进行, 其他需要内容的请求等待读取完成
+enum class LoadState : uint8_t { LOADED, NOT_LOADED, LOADING };
+
 struct MemoryFile {
+	~MemoryFile();
 	std::shared_mutex rw_mutex;
 	bool is_init = false;
-	bool need_flush = false;
+	// 定时扫描不加锁读取, 修改时持有 rw_mutex
+	std::atomic<bool> need_flush{false};
+	// 已从目录树摘除, 由父目录的 rw_mutex 保护(目录自身的 unlinked 同时受自身 rw_mutex 保护)
+	bool unlinked = false;
+	uint64_t ino = 0;
+	// parent 与 name 只在持有父目录写锁时修改, 跨目录移动时同时持有新旧父目录的写锁
+	std::atomic<uint64_t> parent{0};
 	std::string name;
-	char* data = nullptr;
+	// 内核(低层前端)持有的 lookup 计数, 最高位 NLOOKUP_UNLINKED 表示已从目录树摘除
+	// 两者同时满足(计数为 0 且已摘除)时才从 inode 表删除
+	std::atomic<uint64_t> nlookup{0};
+	// 目录: 在 target 中的路径, 子项加载完成后清空; 之后 rename 不影响懒加载
+	// 文件: target 中保存着与内存一致的内容的路径(加载来源, 或从空文件开始完整回写到的路径), 懒加载和淘汰后重新加载都从这里读
+	// 文件被删除后清空; rename 后仍指向原文件, 回写时把原文件 rename 到新路径(失败时整个文件重写)后改为新路径
+	std::string local_path;
+	// 文件被 rename 的次数, 修改时持有 rw_mutex, 见 path_version
+	std::atomic<uint64_t> renames{0};
+	// 只有 NOT_LOADED -> LOADING -> LOADED/NOT_LOADED 的变化, 修改时持有 rw_mutex
+	std::atomic<LoadState> load_state{LoadState::LOADED};
+	// 打开的句柄数
+	std::atomic<uint32_t> open_count{0};
+	// CLOCK 淘汰的访问位, 关闭句柄时设置; in_clock 表示已在淘汰器的 CLOCK 中
+	std::atomic<bool> referenced{false};
+	std::atomic<bool> in_clock{false};
+	// 内容被淘汰过, 由 rw_mutex 保护
+	bool evicted = false;
+	// 最近一次打开, 读写或截断的时间; compress_done 表示之后没再访问过且已压缩过一遍
+	std::atomic<time_t> last_access{0};
+	std::atomic<bool> compress_done{false};
+	// 文件内容, size 之后的字节始终为零
+	FileData data;
 	uint64_t size = 0;
-	uint64_t data_size = 0;
 	mode_t mode = S_IFREG | 0111;
 	time_t ctime = 0;
 	time_t mtime = 0;
 	time_t atime = 0;
 	off_t offset = 0;
-	std::vector<int64_t*>* write_areas;
-	std::set<std::string>* children;
+	// 自上次回写以来修改过的区间; need_flush 表示有脏区间或大小变化还没写回
+	DirtyExtents dirty;
+	// 自上次回写快照以来截断到的最小大小, 回写时 target 文件先截断到这里, 之后扩展出的部分在 target 中也是零
+	uint64_t shrink_size = UINT64_MAX;
+	// 已交给回写引擎, 同一文件同时只有一个回写任务
+	bool writeback_queued = false;
+	// need_flush 从 false 变为 true 的时间
+	std::atomic<time_t> dirty_since{0};
+	// 回写连续失败的次数和下次定时回写的最早时间, 失败次数由 rw_mutex 保护
+	uint32_t write_failures = 0;
+	std::atomic<time_t> retry_after{0};
+	// 目录项: 文件名 -> inode 号, 由 rw_mutex 保护
+	ChildMap* children = nullptr;
 };
 
+using MemoryFilePtr = std::shared_ptr<MemoryFile>;
+
+// MemoryFile 与 shared_ptr 控制块一起从 slab 分配
+inline MemoryFilePtr make_memory_file()
+{
+	return std::allocate_shared<MemoryFile>(SlabStlAllocator<MemoryFile>());
+}
+
+static constexpr uint64_t NLOOKUP_UNLINKED = 1ULL << 63;
+
+inline MemoryFile::~MemoryFile()
+{
+	delete children;
+}
+
 struct Fd {
-	bool used;
 	mode_t mode;
-	MemoryFile* file;
+	MemoryFilePtr file;
 };
-#endif	//MEM_FS_FILE_H
\ No newline at end of file
+#endif	//MEM_FS_FILE_H
@@ -0,0 +1,93 @@
+#ifndef MEM_FS_FUSE_H
+#define MEM_FS_FUSE_H
+// 两种前端共用的 libfuse 版本选择和多线程循环配置
+// libfuse 3.12 起 fuse_loop_config 变为不透明结构, 通过 fuse_loop_cfg_* 设置并支持 max_threads,
+// CMake 检测到 3.12 及以上版本时定义 MEMFS_HAVE_LOOP_CFG
+#ifdef MEMFS_HAVE_LOOP_CFG
+#define FUSE_USE_VERSION 312
+#else
+#define FUSE_USE_VERSION 32
+#endif
+#include <cstring>
+#include <vector>
+#include <fuse3/fuse.h>
+#include <fuse3/fuse_lowlevel.h>
+
+#include "mem_fs.h"
+#include "log_utils.h"
+
+// FUSE_USE_VERSION 35 之前 libfuse 的 ioctl 回调的 cmd 参数是 int
+#if FUSE_USE_VERSION < 35
+typedef int fuse_ioctl_cmd_t;
+#else
+typedef unsigned int fuse_ioctl_cmd_t;
+#endif
+
+// 命令行 --max_threads 等选项优先, 未指定时使用 -o max_idle_threads 等 libfuse 选项的解析结果
+inline struct fuse_loop_config* create_loop_config(const struct fuse_cmdline_opts& opts)
+{
+	unsigned int max_idle_threads = loop_config.max_idle_threads != 0 ? loop_config.max_idle_threads
+																	  : opts.max_idle_threads;
+	bool clone_fd = loop_config.clone_fd || opts.clone_fd;
+#ifdef MEMFS_HAVE_LOOP_CFG
+	unsigned int max_threads = loop_config.max_threads != 0 ? loop_config.max_threads : opts.max_threads;
+	struct fuse_loop_config* config = fuse_loop_cfg_create();
+	if (config == nullptr) {
+		return nullptr;
+	}
+	fuse_loop_cfg_set_clone_fd(config, clone_fd);
+	fuse_loop_cfg_set_idle_threads(config, max_idle_threads);
+	fuse_loop_cfg_set_max_threads(config, max_threads);
+	LOGI("fuse loop: max threads %u, max idle threads %u, clone fd %d\n", max_threads, max_idle_threads, clone_fd);
+#else
+	if (loop_config.max_threads != 0) {
+		LOGE("--max_threads requires libfuse 3.12 or newer, ignored\n");
+	}
+	struct fuse_loop_config* config = new fuse_loop_config();
+	config->clone_fd = clone_fd;
+	config->max_idle_threads = max_idle_threads;
+	LOGI("fuse loop: max idle threads %u, clone fd %d\n", max_idle_threads, clone_fd);
+#endif
+	return config;
+}
+
+inline void destroy_loop_config(struct fuse_loop_config* config)
+{
+#ifdef MEMFS_HAVE_LOOP_CFG
+	fuse_loop_cfg_destroy(config);
+#else
+	delete config;
+#endif
+}
+
+// 把指向文件存储的 iovec 包装成 fuse_bufvec, 返回值在同一线程下一次调用前有效
+inline struct fuse_bufvec* iov_to_bufvec(const struct iovec* iov, int count)
+{
+	thread_local std::vector<char> storage;
+	size_t buf_count = count > 0 ? count : 1;
+	storage.assign(sizeof(struct fuse_bufvec) + (buf_count - 1) * sizeof(struct fuse_buf), 0);
+	struct fuse_bufvec* bufv = reinterpret_cast<struct fuse_bufvec*>(storage.data());
+	bufv->count = buf_count;
+	for (int i = 0; i < count; i++) {
+		bufv->buf[i].mem = iov[i].iov_base;
+		bufv->buf[i].size = iov[i].iov_len;
+		bufv->buf[i].fd = -1;
+	}
+	if (count <= 0) {
+		bufv->buf[0].fd = -1;
+	}
+	return bufv;
+}
+
+// --splice 打开时请求内核用 splice 收发读写数据, 否则显式关闭
+inline void setup_splice(struct fuse_conn_info* conn)
+{
+	unsigned int splice_caps = FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_READ;
+	if (io_config.splice) {
+		conn->want |= conn->capable & splice_caps;
+	} else {
+		conn->want &= ~splice_caps;
+	}
+	LOGI("splice %s\n", (conn->want & splice_caps) != 0 ? "enabled" : "disabled");
+}
+#endif	// MEM_FS_FUSE_H
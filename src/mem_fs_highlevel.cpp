@@ -0,0 +1,379 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+
+#include "mem_fs_fuse.h"
+
+// 高层(基于路径)的 FUSE 前端: 每次回调先把路径解析成 inode 再调用核心操作
+using namespace std;
+
+static std::string find_parent_dir(const std::string& path)
+{
+	size_t last_slash = path.find_last_of('/');
+	if (last_slash == std::string::npos || last_slash == 0) {
+		return "/";
+	}
+	return path.substr(0, last_slash);
+}
+
+static std::string get_name_from_path(const std::string& path)
+{
+	size_t last_slash = path.find_last_of('/');
+	if (last_slash == std::string::npos) {
+		return path;
+	}
+	if (last_slash == path.length() - 1) {
+		size_t prev_slash = path.find_last_of('/', last_slash - 1);
+		return path.substr(prev_slash + 1, last_slash - prev_slash - 1);
+	}
+	return path.substr(last_slash + 1);
+}
+
+static int32_t stat_by_path(const std::string& path, struct stat* stbuf)
+{
+	LOGD("stat %s\n", path.c_str());
+	auto file = get_file_by_path(path);
+	if (file == nullptr) {
+		return -ENOENT;
+	}
+	stat_by_file(file, stbuf);
+	return 0;
+}
+
+static int memfs_getattr(const char* path, struct stat* stbuf, struct fuse_file_info* fi)
+{
+	(void)fi;
+	int32_t ret = stat_by_path(path, stbuf);
+	if (ret != 0) {
+		LOGE("stat fail, ret is %d\n", ret);
+		return ret;
+	}
+	return 0;
+}
+
+static int memfs_readdir(const char* path,
+						 void* buf,
+						 fuse_fill_dir_t filler,
+						 off_t offset,
+						 struct fuse_file_info* fi,
+						 fuse_readdir_flags flags)
+{
+	(void)offset;
+	(void)fi;
+	LOGD("readdir %s\n", path);
+	if (string(path) != "/") {
+		filler(buf, "..", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+	}
+	filler(buf, ".", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+	auto dir = get_file_by_path(path);
+	if (dir == nullptr) {
+		return -ENOENT;
+	}
+	return do_readdir(dir, [buf, filler](const std::string& name, const MemoryFilePtr& file) {
+		LOGD("readdir file name is %s\n", name.c_str());
+		filler(buf, name.c_str(), nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+		return true;
+	});
+}
+
+static int memfs_mkdir(const char* path, mode_t mode)
+{
+	LOGD("mkdir %s\n", path);
+	MemoryFilePtr new_dir;
+	return do_mkdir(get_file_by_path(find_parent_dir(path)), get_name_from_path(path), mode, new_dir);
+}
+
+static int memfs_rmdir(const char* path)
+{
+	LOGD("rmdir %s\n", path);
+	if (string(path) == "/") {
+		return -EBUSY;
+	}
+	return do_rmdir(get_file_by_path(find_parent_dir(path)), get_name_from_path(path));
+}
+
+static int memfs_rename(const char* from, const char* to, unsigned int flags)
+{
+	LOGD("rename %s to %s, flags is %u\n", from, to, flags);
+	return do_rename(get_file_by_path(find_parent_dir(from)),
+					 get_name_from_path(from),
+					 get_file_by_path(find_parent_dir(to)),
+					 get_name_from_path(to),
+					 flags);
+}
+
+static int memfs_open(const char* path, struct fuse_file_info* fi)
+{
+	LOGD("open %s\n", path);
+
+	auto file = get_file_by_path(path);
+	if (file == nullptr) {
+		if (!(fi->flags & O_CREAT)) {
+			return -ENOENT;
+		}
+		int32_t ret = do_create(get_file_by_path(find_parent_dir(path)), get_name_from_path(path), 0644, file);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+	return do_open(file, fi->flags, fi->fh);
+}
+
+static int memfs_create(const char* path, mode_t mode, struct fuse_file_info* fi)
+{
+	LOGD("create %s\n", path);
+	MemoryFilePtr file;
+	int32_t ret = do_create(get_file_by_path(find_parent_dir(path)), get_name_from_path(path), 0644, file);
+	if (ret != 0) {
+		return ret;
+	}
+	return do_open(file, fi->flags, fi->fh);
+}
+
+// 不实现 read_buf: 高层接口在回调返回后才发送 bufvec, 那时已不再持有文件锁, 不能直接引用文件存储
+static int memfs_read(const char* path, char* buf, size_t size, off_t offset, struct fuse_file_info* fi)
+{
+	LOGD("read %s\n", path);
+	return do_read(fi->fh, buf, size, offset);
+}
+
+static int memfs_write_buf(const char* path, struct fuse_bufvec* buf, off_t offset, struct fuse_file_info* fi)
+{
+	LOGD("write %s\n", path);
+	return do_write_with(fi->fh, fuse_buf_size(buf), offset, [buf](const struct iovec* iov, int count) {
+		return fuse_buf_copy(iov_to_bufvec(iov, count), buf, (enum fuse_buf_copy_flags)0);
+	});
+}
+
+static int memfs_utimens(const char* path, const struct timespec ts[2], struct fuse_file_info* fi)
+{
+	(void)fi;
+	LOGD("utimens %s\n", path);
+	auto file = get_file_by_path(path);
+	if (file == nullptr) {
+		return -ENOENT;
+	}
+	return do_utimens(file, ts);
+}
+
+static int memfs_chmod(const char* path, mode_t mode, struct fuse_file_info* fi)
+{
+	(void)fi;
+	LOGD("chmod %s\n", path);
+	auto file = get_file_by_path(path);
+	if (file == nullptr) {
+		return -ENOENT;
+	}
+	return do_chmod(file, mode);
+}
+
+static int memfs_flush(const char* path, struct fuse_file_info* fi)
+{
+	(void)fi;
+	LOGD("flush %s\n", path);
+	return 0;
+}
+
+static int memfs_release(const char* path, struct fuse_file_info* fi)
+{
+	LOGD("release %s\n", path);
+	int32_t ret = do_release(fi->fh);
+	if (ret != 0) {
+		return ret;
+	}
+	fi->fh = -1;
+	return 0;
+}
+
+static int memfs_fsync(const char* path, int datasync, struct fuse_file_info* fi)
+{
+	LOGD("fsync %s\n", path);
+	return do_fsync(fi->fh, datasync != 0);
+}
+
+static int memfs_truncate(const char* path, off_t size, struct fuse_file_info* fi)
+{
+	LOGD("truncate %s\n", path);
+	auto file = get_file_by_path(path);
+	if (file == nullptr) {
+		return -ENOENT;
+	}
+	return do_truncate(file, size);
+}
+
+static int memfs_unlink(const char* path)
+{
+	LOGD("unlink %s\n", path);
+	return do_unlink(get_file_by_path(find_parent_dir(path)), get_name_from_path(path));
+}
+
+static off_t memfs_lseek(const char* path, off_t offset, int whence, struct fuse_file_info* fi)
+{
+	LOGD("lseek %s\n", path);
+	return do_lseek(fi->fh, offset, whence);
+}
+
+static int memfs_fallocate(const char* path, int mode, off_t offset, off_t length, struct fuse_file_info* fi)
+{
+	LOGD("fallocate %s, mode is %x\n", path, mode);
+	return do_fallocate(fi->fh, mode, offset, length);
+}
+
+static ssize_t memfs_copy_file_range(const char* path_in,
+									 struct fuse_file_info* fi_in,
+									 off_t offset_in,
+									 const char* path_out,
+									 struct fuse_file_info* fi_out,
+									 off_t offset_out,
+									 size_t size,
+									 int flags)
+{
+	LOGD("copy_file_range %s to %s\n", path_in, path_out);
+	if (flags != 0) {
+		return -EINVAL;
+	}
+	return do_copy_file_range(fi_in->fh, offset_in, fi_out->fh, offset_out, size);
+}
+
+static int memfs_ioctl(const char* path,
+					   fuse_ioctl_cmd_t ioctl_cmd,
+					   void* arg,
+					   struct fuse_file_info* fi,
+					   unsigned int flags,
+					   void* data)
+{
+	(void)arg;
+	unsigned int cmd = ioctl_cmd;
+	LOGD("ioctl %s, cmd is %x\n", path, cmd);
+	if ((flags & (FUSE_IOCTL_COMPAT | FUSE_IOCTL_DIR)) != 0) {
+		return -ENOTTY;
+	}
+	if (cmd == MEMFS_IOC_SNAPSHOT) {
+		return do_snapshot();
+	}
+	if (cmd != MEMFS_IOC_CLONE_RANGE) {
+		return -ENOTTY;
+	}
+	struct memfs_clone_range clone;
+	memcpy(&clone, data, sizeof(clone));
+	return do_clone_range(fi->fh, clone);
+}
+
+static void* memfs_init(struct fuse_conn_info* conn, struct fuse_config* cfg)
+{
+	LOGD("memfs_init\n");
+	setup_splice(conn);
+	// 高层接口没有失效通知, 克隆 ioctl 等修改不经过内核的缓存, 所以不用 cache_config 的长超时,
+	// 保留 libfuse 的默认值(可以用 -o entry_timeout= 等选项修改)
+	(void)cfg;
+	return nullptr;
+}
+
+static void memfs_destroy(void* private_data)
+{
+	(void)private_data;
+	log_cache_stats(LOG_LEVEL_INFO);
+}
+
+// 实现 FUSE 操作
+static struct fuse_operations memfs_ops = {
+	.getattr = memfs_getattr,
+	.mkdir = memfs_mkdir,
+	.unlink = memfs_unlink,
+	.rmdir = memfs_rmdir,
+	.rename = memfs_rename,
+	.chmod = memfs_chmod,
+	.truncate = memfs_truncate,
+	.open = memfs_open,
+	.read = memfs_read,
+	.flush = memfs_flush,
+	.release = memfs_release,
+	.fsync = memfs_fsync,
+	.readdir = memfs_readdir,
+	.init = memfs_init,
+	.destroy = memfs_destroy,
+	.create = memfs_create,
+	.utimens = memfs_utimens,
+	.ioctl = memfs_ioctl,
+	.write_buf = memfs_write_buf,
+	.fallocate = memfs_fallocate,
+	.copy_file_range = memfs_copy_file_range,
+	.lseek = memfs_lseek,
+};
+
+// 与 fuse_main 的流程相同, 只是自己驱动多线程循环以便传入 fuse_loop_config
+int run_highlevel(int argc, char* argv[])
+{
+	LOGI("use high level fuse api\n");
+	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+	struct fuse_cmdline_opts opts;
+	struct fuse* fuse = nullptr;
+	int ret = 1;
+
+	if (fuse_parse_cmdline(&args, &opts) != 0) {
+		return 1;
+	}
+	if (opts.show_help) {
+		printf("usage: %s [options] <mountpoint>\n\n", argv[0]);
+		fuse_cmdline_help();
+		fuse_lib_help(&args);
+		ret = 0;
+		goto out;
+	}
+	if (opts.show_version) {
+		fuse_lowlevel_version();
+		ret = 0;
+		goto out;
+	}
+	if (opts.mountpoint == nullptr) {
+		LOGE("no mountpoint specified\n");
+		goto out;
+	}
+
+	fuse = fuse_new(&args, &memfs_ops, sizeof(memfs_ops), nullptr);
+	if (fuse == nullptr) {
+		goto out;
+	}
+	if (fuse_mount(fuse, opts.mountpoint) != 0) {
+		goto destroy;
+	}
+	if (fuse_daemonize(opts.foreground) != 0) {
+		goto unmount;
+	}
+	if (fuse_set_signal_handlers(fuse_get_session(fuse)) != 0) {
+		goto unmount;
+	}
+	// 在 daemonize 之后启动, fork 不会保留其他线程
+	writeback.start(writeback_config);
+	evictor.start(evict_config);
+	compressor.start(compress_config);
+	if (opts.singlethread) {
+		ret = fuse_loop(fuse);
+	} else {
+		struct fuse_loop_config* config = create_loop_config(opts);
+		ret = fuse_loop_mt(fuse, config);
+		destroy_loop_config(config);
+	}
+	compressor.stop();
+	evictor.stop();
+	// 退出前把剩余的脏数据全部写回
+	flush_files();
+	writeback.stop();
+	// 脏数据已全部写回, 镜像与 target 一致
+	if (!snapshot_config.path.empty()) {
+		save_snapshot(snapshot_config.path);
+	}
+	fuse_remove_signal_handlers(fuse_get_session(fuse));
+unmount:
+	fuse_unmount(fuse);
+destroy:
+	fuse_destroy(fuse);
+out:
+	free(opts.mountpoint);
+	fuse_opt_free_args(&args);
+	return ret ? 1 : 0;
+}
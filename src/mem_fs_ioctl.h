@@ -0,0 +1,26 @@
+#ifndef MEM_FS_IOCTL_H
+#define MEM_FS_IOCTL_H
+#include <linux/ioctl.h>
+#include <stdint.h>
+
+// memfs 自己的 ioctl, 在挂载点内的文件上调用, 供需要克隆文件的工具使用(C 和 C++ 都可以包含)
+// 内核的 FICLONE/FICLONERANGE 传的是调用者进程中的 fd, FUSE 文件系统无法解析, 所以源文件用路径指定
+
+#define MEMFS_CLONE_PATH_MAX 4072
+
+// 在目标文件(以可写方式打开)的 fd 上调用: 把源文件的 [src_offset, src_offset + src_length) 克隆到 dest_offset,
+// 整块对齐的部分与源文件共享内存, 之后任意一方写入时才拷贝; src_length 为 0 表示到源文件末尾
+// 源文件路径相对挂载点根目录, 如 "/dir/file"; 范围超出源文件末尾, 或同一文件内范围重叠时返回 EINVAL
+struct memfs_clone_range {
+	uint64_t src_offset;
+	uint64_t src_length;
+	uint64_t dest_offset;
+	char src_path[MEMFS_CLONE_PATH_MAX];
+};
+
+#define MEMFS_IOC_CLONE_RANGE _IOW('M', 1, struct memfs_clone_range)
+
+// 在挂载点内任意已打开的文件上调用: 立即把当前目录树和已加载的文件内容写入 --snapshot 指定的镜像
+// 没有指定 --snapshot 时返回 EINVAL
+#define MEMFS_IOC_SNAPSHOT _IO('M', 2)
+#endif
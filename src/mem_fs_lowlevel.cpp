@@ -0,0 +1,659 @@
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "mem_fs_fuse.h"
+
+// 低层(基于 inode)的 FUSE 前端: 内核直接传入 inode 号, 不再由 libfuse 维护路径表
+using namespace std;
+
+// 按类型统计收到的请求数, 用于对比不同缓存超时下内核回到用户态的次数
+enum RequestType {
+	REQ_LOOKUP,
+	REQ_FORGET,
+	REQ_GETATTR,
+	REQ_SETATTR,
+	REQ_MKDIR,
+	REQ_UNLINK,
+	REQ_RMDIR,
+	REQ_RENAME,
+	REQ_CREATE,
+	REQ_OPEN,
+	REQ_READ,
+	REQ_WRITE,
+	REQ_FLUSH,
+	REQ_RELEASE,
+	REQ_FSYNC,
+	REQ_LSEEK,
+	REQ_OPENDIR,
+	REQ_READDIR,
+	REQ_RELEASEDIR,
+	REQ_COPY_FILE_RANGE,
+	REQ_IOCTL,
+	REQ_FALLOCATE,
+	REQ_TYPE_COUNT,
+};
+
+static const char* request_names[REQ_TYPE_COUNT] = {
+	"lookup", "forget", "getattr", "setattr", "mkdir",	 "unlink",	"rmdir",   "rename",  "create",
+	"open",	  "read",	"write",   "flush",	  "release", "fsync",	"lseek",   "opendir", "readdir", "releasedir",
+	"copy_file_range", "ioctl", "fallocate",
+};
+
+static std::atomic<uint64_t> request_counts[REQ_TYPE_COUNT];
+static struct fuse_session* session = nullptr;
+
+static void count_request(RequestType type)
+{
+	request_counts[type].fetch_add(1, std::memory_order_relaxed);
+}
+
+static void log_request_stats()
+{
+	std::string stats;
+	uint64_t total = 0;
+	for (int i = 0; i < REQ_TYPE_COUNT; i++) {
+		uint64_t count = request_counts[i].load(std::memory_order_relaxed);
+		total += count;
+		if (count != 0) {
+			stats += std::string(" ") + request_names[i] + "=" + std::to_string(count);
+		}
+	}
+	LOGI("requests: total=%lu%s, invalidations sent=%lu\n", total, stats.c_str(), notifier.sent());
+}
+
+// opendir 时对目录内容做快照, readdir 按下标作为 offset 续读
+struct DirHandle {
+	std::vector<std::pair<std::string, struct stat>> entries;
+};
+
+static MemoryFilePtr get_file(fuse_ino_t ino)
+{
+	return inodes.get(ino);
+}
+
+static void stat_locked(const MemoryFilePtr& file, struct stat* stbuf)
+{
+	shared_lock<shared_mutex> lock(file->rw_mutex);
+	stat_by_file(file, stbuf);
+}
+
+// 回复成功后内核持有一次 lookup 计数, 直到 forget
+static void reply_entry(fuse_req_t req, const MemoryFilePtr& file)
+{
+	if (!hold_inode(file)) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	struct fuse_entry_param e;
+	memset(&e, 0, sizeof(e));
+	e.ino = file->ino;
+	e.attr_timeout = cache_config.attr_timeout;
+	e.entry_timeout = cache_config.entry_timeout;
+	stat_locked(file, &e.attr);
+	if (fuse_reply_entry(req, &e) != 0) {
+		forget_inode(file, 1);
+	}
+}
+
+static void memfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char* name)
+{
+	count_request(REQ_LOOKUP);
+	LOGD("lookup %s in %lu\n", name, parent);
+	auto dir = get_file(parent);
+	if (dir == nullptr) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	if (!S_ISDIR(dir->mode)) {
+		fuse_reply_err(req, ENOTDIR);
+		return;
+	}
+	auto file = lookup_child(dir, name);
+	if (file == nullptr) {
+		if (cache_config.negative_timeout > 0) {
+			// ino 为 0 的回复让内核缓存一个不存在的目录项
+			struct fuse_entry_param e;
+			memset(&e, 0, sizeof(e));
+			e.entry_timeout = cache_config.negative_timeout;
+			fuse_reply_entry(req, &e);
+			return;
+		}
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	reply_entry(req, file);
+}
+
+static void memfs_ll_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup)
+{
+	count_request(REQ_FORGET);
+	auto file = get_file(ino);
+	if (file != nullptr) {
+		forget_inode(file, nlookup);
+	}
+	fuse_reply_none(req);
+}
+
+static void memfs_ll_forget_multi(fuse_req_t req, size_t count, struct fuse_forget_data* forgets)
+{
+	count_request(REQ_FORGET);
+	for (size_t i = 0; i < count; i++) {
+		auto file = get_file(forgets[i].ino);
+		if (file != nullptr) {
+			forget_inode(file, forgets[i].nlookup);
+		}
+	}
+	fuse_reply_none(req);
+}
+
+static void memfs_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi)
+{
+	count_request(REQ_GETATTR);
+	(void)fi;
+	auto file = get_file(ino);
+	if (file == nullptr) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	struct stat stbuf;
+	stat_locked(file, &stbuf);
+	fuse_reply_attr(req, &stbuf, cache_config.attr_timeout);
+}
+
+static void memfs_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat* attr, int to_set, struct fuse_file_info* fi)
+{
+	count_request(REQ_SETATTR);
+	(void)fi;
+	LOGD("setattr %lu, to_set is %x\n", ino, to_set);
+	auto file = get_file(ino);
+	if (file == nullptr) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	int32_t ret = 0;
+	if (to_set & FUSE_SET_ATTR_MODE) {
+		ret = do_chmod(file, attr->st_mode);
+		if (ret != 0) {
+			fuse_reply_err(req, -ret);
+			return;
+		}
+	}
+	if (to_set & FUSE_SET_ATTR_SIZE) {
+		if (S_ISDIR(file->mode)) {
+			fuse_reply_err(req, EISDIR);
+			return;
+		}
+		ret = do_truncate(file, attr->st_size);
+		if (ret != 0) {
+			fuse_reply_err(req, -ret);
+			return;
+		}
+	}
+	if (to_set & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME)) {
+		struct timespec ts[2];
+		ts[0].tv_sec = 0;
+		ts[0].tv_nsec = UTIME_OMIT;
+		ts[1] = ts[0];
+		if (to_set & FUSE_SET_ATTR_ATIME) {
+			ts[0] = attr->st_atim;
+			if (to_set & FUSE_SET_ATTR_ATIME_NOW) {
+				ts[0].tv_nsec = UTIME_NOW;
+			}
+		}
+		if (to_set & FUSE_SET_ATTR_MTIME) {
+			ts[1] = attr->st_mtim;
+			if (to_set & FUSE_SET_ATTR_MTIME_NOW) {
+				ts[1].tv_nsec = UTIME_NOW;
+			}
+		}
+		ret = do_utimens(file, ts);
+		if (ret != 0) {
+			fuse_reply_err(req, -ret);
+			return;
+		}
+	}
+	struct stat stbuf;
+	stat_locked(file, &stbuf);
+	fuse_reply_attr(req, &stbuf, cache_config.attr_timeout);
+}
+
+static void memfs_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char* name, mode_t mode)
+{
+	count_request(REQ_MKDIR);
+	LOGD("mkdir %s in %lu\n", name, parent);
+	MemoryFilePtr new_dir;
+	int32_t ret = do_mkdir(get_file(parent), name, mode, new_dir);
+	if (ret != 0) {
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	reply_entry(req, new_dir);
+}
+
+static void memfs_ll_unlink(fuse_req_t req, fuse_ino_t parent, const char* name)
+{
+	count_request(REQ_UNLINK);
+	LOGD("unlink %s in %lu\n", name, parent);
+	fuse_reply_err(req, -do_unlink(get_file(parent), name));
+}
+
+static void memfs_ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char* name)
+{
+	count_request(REQ_RMDIR);
+	LOGD("rmdir %s in %lu\n", name, parent);
+	fuse_reply_err(req, -do_rmdir(get_file(parent), name));
+}
+
+static void memfs_ll_rename(fuse_req_t req,
+							fuse_ino_t parent,
+							const char* name,
+							fuse_ino_t newparent,
+							const char* newname,
+							unsigned int flags)
+{
+	count_request(REQ_RENAME);
+	LOGD("rename %s in %lu to %s in %lu, flags is %u\n", name, parent, newname, newparent, flags);
+	fuse_reply_err(req, -do_rename(get_file(parent), name, get_file(newparent), newname, flags));
+}
+
+static void memfs_ll_create(fuse_req_t req, fuse_ino_t parent, const char* name, mode_t mode, struct fuse_file_info* fi)
+{
+	count_request(REQ_CREATE);
+	LOGD("create %s in %lu\n", name, parent);
+	MemoryFilePtr file;
+	int32_t ret = do_create(get_file(parent), name, mode & 07777, file);
+	if (ret != 0) {
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	ret = do_open(file, fi->flags, fi->fh);
+	if (ret != 0) {
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	if (!hold_inode(file)) {
+		do_release(fi->fh);
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	struct fuse_entry_param e;
+	memset(&e, 0, sizeof(e));
+	e.ino = file->ino;
+	e.attr_timeout = cache_config.attr_timeout;
+	e.entry_timeout = cache_config.entry_timeout;
+	stat_locked(file, &e.attr);
+	if (fuse_reply_create(req, &e, fi) != 0) {
+		do_release(fi->fh);
+		forget_inode(file, 1);
+	}
+}
+
+static void memfs_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi)
+{
+	count_request(REQ_OPEN);
+	LOGD("open %lu\n", ino);
+	auto file = get_file(ino);
+	if (file == nullptr) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	int32_t ret = do_open(file, fi->flags, fi->fh);
+	if (ret != 0) {
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	if (fuse_reply_open(req, fi) != 0) {
+		do_release(fi->fh);
+	}
+}
+
+static void memfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info* fi)
+{
+	count_request(REQ_READ);
+	LOGD("read %lu\n", ino);
+	bool replied = false;
+	int32_t ret = do_read_with(fi->fh, size, off, [req, &replied](const struct iovec* iov, int count) {
+		// 持有文件读锁时回复, libfuse 直接从各个块 writev 或 splice 进 /dev/fuse, 返回时数据已拷入内核
+		size_t len = 0;
+		for (int i = 0; i < count; i++) {
+			len += iov[i].iov_len;
+		}
+		replied = true;
+		int ret;
+		if (io_config.splice) {
+			ret = fuse_reply_data(req, iov_to_bufvec(iov, count), (enum fuse_buf_copy_flags)0);
+		} else {
+			ret = fuse_reply_iov(req, iov, count);
+		}
+		return ret != 0 ? ret : static_cast<int32_t>(len);
+	});
+	if (ret < 0 && !replied) {
+		fuse_reply_err(req, -ret);
+	}
+}
+
+static void memfs_ll_write_buf(fuse_req_t req,
+							   fuse_ino_t ino,
+							   struct fuse_bufvec* in_buf,
+							   off_t off,
+							   struct fuse_file_info* fi)
+{
+	count_request(REQ_WRITE);
+	LOGD("write %lu\n", ino);
+	int32_t ret = do_write_with(fi->fh, fuse_buf_size(in_buf), off, [in_buf](const struct iovec* iov, int count) {
+		// splice 时 in_buf 是管道, 数据从管道直接读进文件存储
+		return fuse_buf_copy(iov_to_bufvec(iov, count), in_buf, (enum fuse_buf_copy_flags)0);
+	});
+	if (ret < 0) {
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	fuse_reply_write(req, ret);
+}
+
+static void memfs_ll_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi)
+{
+	count_request(REQ_FLUSH);
+	(void)fi;
+	LOGD("flush %lu\n", ino);
+	fuse_reply_err(req, 0);
+}
+
+static void memfs_ll_fsync(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info* fi)
+{
+	count_request(REQ_FSYNC);
+	LOGD("fsync %lu\n", ino);
+	fuse_reply_err(req, -do_fsync(fi->fh, datasync != 0));
+}
+
+static void memfs_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi)
+{
+	count_request(REQ_RELEASE);
+	LOGD("release %lu\n", ino);
+	fuse_reply_err(req, -do_release(fi->fh));
+}
+
+static void memfs_ll_lseek(fuse_req_t req, fuse_ino_t ino, off_t off, int whence, struct fuse_file_info* fi)
+{
+	count_request(REQ_LSEEK);
+	LOGD("lseek %lu\n", ino);
+	off_t ret = do_lseek(fi->fh, off, whence);
+	if (ret < 0) {
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	fuse_reply_lseek(req, ret);
+}
+
+static void memfs_ll_fallocate(fuse_req_t req,
+							   fuse_ino_t ino,
+							   int mode,
+							   off_t offset,
+							   off_t length,
+							   struct fuse_file_info* fi)
+{
+	count_request(REQ_FALLOCATE);
+	LOGD("fallocate %lu, mode is %x\n", ino, mode);
+	fuse_reply_err(req, -do_fallocate(fi->fh, mode, offset, length));
+}
+
+static void memfs_ll_copy_file_range(fuse_req_t req,
+									 fuse_ino_t ino_in,
+									 off_t off_in,
+									 struct fuse_file_info* fi_in,
+									 fuse_ino_t ino_out,
+									 off_t off_out,
+									 struct fuse_file_info* fi_out,
+									 size_t len,
+									 int flags)
+{
+	count_request(REQ_COPY_FILE_RANGE);
+	LOGD("copy_file_range %lu to %lu\n", ino_in, ino_out);
+	if (flags != 0) {
+		fuse_reply_err(req, EINVAL);
+		return;
+	}
+	ssize_t ret = do_copy_file_range(fi_in->fh, off_in, fi_out->fh, off_out, len);
+	if (ret < 0) {
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	fuse_reply_write(req, ret);
+}
+
+static void memfs_ll_ioctl(fuse_req_t req,
+						   fuse_ino_t ino,
+						   fuse_ioctl_cmd_t ioctl_cmd,
+						   void* arg,
+						   struct fuse_file_info* fi,
+						   unsigned flags,
+						   const void* in_buf,
+						   size_t in_bufsz,
+						   size_t out_bufsz)
+{
+	count_request(REQ_IOCTL);
+	unsigned int cmd = ioctl_cmd;
+	LOGD("ioctl %lu, cmd is %x\n", ino, cmd);
+	int32_t ret;
+	if ((flags & (FUSE_IOCTL_COMPAT | FUSE_IOCTL_DIR)) != 0) {
+		ret = -ENOTTY;
+	} else if (cmd == MEMFS_IOC_SNAPSHOT) {
+		ret = do_snapshot();
+	} else if (cmd == MEMFS_IOC_CLONE_RANGE && in_bufsz >= sizeof(struct memfs_clone_range)) {
+		struct memfs_clone_range clone;
+		memcpy(&clone, in_buf, sizeof(clone));
+		ret = do_clone_range(fi->fh, clone);
+	} else {
+		ret = -ENOTTY;
+	}
+	if (ret != 0) {
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	fuse_reply_ioctl(req, 0, nullptr, 0);
+}
+
+static void memfs_ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi)
+{
+	count_request(REQ_OPENDIR);
+	LOGD("opendir %lu\n", ino);
+	auto dir = get_file(ino);
+	if (dir == nullptr) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	DirHandle* handle = new DirHandle();
+	struct stat stbuf;
+	memset(&stbuf, 0, sizeof(stbuf));
+	stbuf.st_ino = dir->ino;
+	stbuf.st_mode = S_IFDIR;
+	handle->entries.emplace_back(".", stbuf);
+	stbuf.st_ino = ino == FUSE_ROOT_ID ? dir->ino : dir->parent.load();
+	handle->entries.emplace_back("..", stbuf);
+	int32_t ret = do_readdir(dir, [handle, &stbuf](const std::string& name, const MemoryFilePtr& file) {
+		stbuf.st_ino = file->ino;
+		stbuf.st_mode = file->mode & S_IFMT;
+		handle->entries.emplace_back(name, stbuf);
+		return true;
+	});
+	if (ret != 0) {
+		delete handle;
+		fuse_reply_err(req, -ret);
+		return;
+	}
+	fi->fh = reinterpret_cast<uint64_t>(handle);
+	if (fuse_reply_open(req, fi) != 0) {
+		delete handle;
+	}
+}
+
+static void memfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info* fi)
+{
+	count_request(REQ_READDIR);
+	LOGD("readdir %lu, offset is %ld\n", ino, off);
+	DirHandle* handle = reinterpret_cast<DirHandle*>(fi->fh);
+	std::vector<char> buf(size);
+	size_t pos = 0;
+	for (size_t i = off; i < handle->entries.size(); i++) {
+		const auto& entry = handle->entries[i];
+		size_t len = fuse_add_direntry(req, buf.data() + pos, size - pos, entry.first.c_str(), &entry.second, i + 1);
+		if (len > size - pos) {
+			break;
+		}
+		pos += len;
+	}
+	fuse_reply_buf(req, buf.data(), pos);
+}
+
+static void memfs_ll_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi)
+{
+	count_request(REQ_RELEASEDIR);
+	(void)ino;
+	delete reinterpret_cast<DirHandle*>(fi->fh);
+	fuse_reply_err(req, 0);
+}
+
+static void memfs_ll_init(void* userdata, struct fuse_conn_info* conn)
+{
+	(void)userdata;
+	LOGD("memfs_ll_init\n");
+	setup_splice(conn);
+}
+
+static void memfs_ll_destroy(void* userdata)
+{
+	(void)userdata;
+	log_cache_stats(LOG_LEVEL_INFO);
+	log_request_stats();
+}
+
+static void notify_inval_inode(uint64_t ino)
+{
+	// off 为负数时只丢弃属性缓存, 保留页缓存
+	int ret = fuse_lowlevel_notify_inval_inode(session, ino, -1, 0);
+	if (ret != 0 && ret != -ENOENT) {
+		LOGD("notify inval inode %lu failed, ret is %d\n", ino, ret);
+	}
+}
+
+static void notify_inval_entry(uint64_t parent, const std::string& name)
+{
+	int ret = fuse_lowlevel_notify_inval_entry(session, parent, name.c_str(), name.length());
+	if (ret != 0 && ret != -ENOENT) {
+		LOGD("notify inval entry %s in %lu failed, ret is %d\n", name.c_str(), parent, ret);
+	}
+}
+
+static struct fuse_lowlevel_ops memfs_ll_ops = {
+	.init = memfs_ll_init,
+	.destroy = memfs_ll_destroy,
+	.lookup = memfs_ll_lookup,
+	.forget = memfs_ll_forget,
+	.getattr = memfs_ll_getattr,
+	.setattr = memfs_ll_setattr,
+	.mkdir = memfs_ll_mkdir,
+	.unlink = memfs_ll_unlink,
+	.rmdir = memfs_ll_rmdir,
+	.rename = memfs_ll_rename,
+	.open = memfs_ll_open,
+	.read = memfs_ll_read,
+	.flush = memfs_ll_flush,
+	.release = memfs_ll_release,
+	.fsync = memfs_ll_fsync,
+	.opendir = memfs_ll_opendir,
+	.readdir = memfs_ll_readdir,
+	.releasedir = memfs_ll_releasedir,
+	.create = memfs_ll_create,
+	.ioctl = memfs_ll_ioctl,
+	.write_buf = memfs_ll_write_buf,
+	.forget_multi = memfs_ll_forget_multi,
+	.fallocate = memfs_ll_fallocate,
+	.copy_file_range = memfs_ll_copy_file_range,
+	.lseek = memfs_ll_lseek,
+};
+
+int run_lowlevel(int argc, char* argv[])
+{
+	LOGI("use low level fuse api\n");
+	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+	struct fuse_cmdline_opts opts;
+	struct fuse_session* se = nullptr;
+	int ret = 1;
+
+	if (fuse_parse_cmdline(&args, &opts) != 0) {
+		return 1;
+	}
+	if (opts.show_help) {
+		printf("usage: %s [options] <mountpoint>\n\n", argv[0]);
+		fuse_cmdline_help();
+		fuse_lowlevel_help();
+		ret = 0;
+		goto out;
+	}
+	if (opts.show_version) {
+		fuse_lowlevel_version();
+		ret = 0;
+		goto out;
+	}
+	if (opts.mountpoint == nullptr) {
+		LOGE("no mountpoint specified\n");
+		goto out;
+	}
+
+	se = fuse_session_new(&args, &memfs_ll_ops, sizeof(memfs_ll_ops), nullptr);
+	if (se == nullptr) {
+		goto out;
+	}
+	session = se;
+	if (fuse_set_signal_handlers(se) != 0) {
+		goto destroy;
+	}
+	if (fuse_session_mount(se, opts.mountpoint) != 0) {
+		goto remove_handlers;
+	}
+	fuse_daemonize(opts.foreground);
+	// 在 daemonize 之后启动, fork 不会保留其他线程
+	notifier.start(notify_inval_inode, notify_inval_entry);
+	writeback.start(writeback_config);
+	evictor.start(evict_config);
+	compressor.start(compress_config);
+	LOGI("entry timeout %.1fs, attr timeout %.1fs, negative timeout %.1fs\n",
+		 cache_config.entry_timeout,
+		 cache_config.attr_timeout,
+		 cache_config.negative_timeout);
+	if (opts.singlethread) {
+		ret = fuse_session_loop(se);
+	} else {
+		struct fuse_loop_config* config = create_loop_config(opts);
+		ret = fuse_session_loop_mt(se, config);
+		destroy_loop_config(config);
+	}
+	notifier.stop();
+	compressor.stop();
+	evictor.stop();
+	// 退出前把剩余的脏数据全部写回
+	flush_files();
+	writeback.stop();
+	// 脏数据已全部写回, 镜像与 target 一致
+	if (!snapshot_config.path.empty()) {
+		save_snapshot(snapshot_config.path);
+	}
+	fuse_session_unmount(se);
+remove_handlers:
+	fuse_remove_signal_handlers(se);
+destroy:
+	session = nullptr;
+	fuse_session_destroy(se);
+out:
+	free(opts.mountpoint);
+	fuse_opt_free_args(&args);
+	return ret ? 1 : 0;
+}
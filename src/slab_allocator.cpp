@@ -0,0 +1,222 @@
+#include "slab_allocator.h"
+
+#include <algorithm>
+#include <new>
+#include <sys/mman.h>
+
+static constexpr size_t CLASS_SIZES[SlabAllocator::CLASS_COUNT] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096, 8192, 16384, 32768, 65536,
+};
+static constexpr size_t MIN_SLAB_SIZE = 1024 * 1024;
+static constexpr size_t BATCH_BYTES = 256 * 1024;
+static constexpr size_t MAX_BATCH = 64;
+
+// 每个线程每级的空闲对象, 只由所属线程修改; cached 供统计时其他线程读取
+struct SlabAllocator::ThreadCache {
+	FreeList lists[CLASS_COUNT];
+	std::atomic<uint64_t> cached[CLASS_COUNT];
+	ThreadCache()
+	{
+		for (auto& count : cached) {
+			count.store(0, std::memory_order_relaxed);
+		}
+		SlabAllocator::instance().register_cache(this);
+	}
+	~ThreadCache()
+	{
+		SlabAllocator& allocator = SlabAllocator::instance();
+		for (size_t i = 0; i < CLASS_COUNT; i++) {
+			allocator.drain(i, lists[i], lists[i].count);
+		}
+		allocator.unregister_cache(this);
+	}
+};
+
+// 永不析构, 线程退出时的 ThreadCache 析构可能晚于静态对象析构
+SlabAllocator& SlabAllocator::instance()
+{
+	static SlabAllocator* allocator = new SlabAllocator();
+	return *allocator;
+}
+
+SlabAllocator::SlabAllocator()
+{
+	for (size_t i = 0; i < CLASS_COUNT; i++) {
+		SizeClass& size_class = classes_[i];
+		size_class.size = CLASS_SIZES[i];
+		size_class.batch = std::max<size_t>(2, std::min(MAX_BATCH, BATCH_BYTES / size_class.size));
+		size_class.slab_size = std::max(MIN_SLAB_SIZE, size_class.size * size_class.batch);
+	}
+}
+
+size_t SlabAllocator::class_of(size_t size)
+{
+	// 小于等于 4096 的请求按 16 字节粒度查表, 其余都是 2 的幂
+	static const std::array<uint8_t, 257> small_classes = [] {
+		std::array<uint8_t, 257> table{};
+		size_t index = 0;
+		for (size_t i = 0; i < table.size(); i++) {
+			while (CLASS_SIZES[index] < i * 16) {
+				index++;
+			}
+			table[i] = index;
+		}
+		return table;
+	}();
+	if (size <= 4096) {
+		return small_classes[(size + 15) / 16];
+	}
+	size_t index = 16;
+	while (CLASS_SIZES[index] < size) {
+		index++;
+	}
+	return index;
+}
+
+SlabAllocator::ThreadCache& SlabAllocator::thread_cache()
+{
+	thread_local ThreadCache cache;
+	return cache;
+}
+
+void SlabAllocator::refill(size_t index, FreeList& list)
+{
+	SizeClass& size_class = classes_[index];
+	std::unique_lock<std::mutex> lock(size_class.mutex);
+	if (size_class.free_list.count == 0) {
+		void* slab = mmap(nullptr, size_class.slab_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (slab == MAP_FAILED) {
+			throw std::bad_alloc();
+		}
+		char* base = static_cast<char*>(slab);
+		for (size_t offset = size_class.slab_size; offset >= size_class.size; offset -= size_class.size) {
+			FreeObject* object = reinterpret_cast<FreeObject*>(base + offset - size_class.size);
+			object->next = size_class.free_list.head;
+			size_class.free_list.head = object;
+		}
+		size_class.free_list.count += size_class.slab_size / size_class.size;
+		size_class.reserved.fetch_add(size_class.slab_size, std::memory_order_relaxed);
+	}
+	size_t moved = 0;
+	while (moved < size_class.batch && size_class.free_list.head != nullptr) {
+		FreeObject* object = size_class.free_list.head;
+		size_class.free_list.head = object->next;
+		object->next = list.head;
+		list.head = object;
+		moved++;
+	}
+	size_class.free_list.count -= moved;
+	size_class.central_free.store(size_class.free_list.count * size_class.size, std::memory_order_relaxed);
+	list.count += moved;
+}
+
+void SlabAllocator::drain(size_t index, FreeList& list, size_t count)
+{
+	if (count == 0) {
+		return;
+	}
+	SizeClass& size_class = classes_[index];
+	FreeObject* first = list.head;
+	FreeObject* last = first;
+	for (size_t i = 1; i < count; i++) {
+		last = last->next;
+	}
+	list.head = last->next;
+	list.count -= count;
+
+	std::unique_lock<std::mutex> lock(size_class.mutex);
+	if (size_class.size > 4096 && size_class.free_list.count * size_class.size >= RELEASE_THRESHOLD) {
+		// 保留存放链表指针的第一页, 其余页还给系统, 再次使用时由缺页重新分配
+		for (FreeObject* object = first;; object = object->next) {
+			madvise(reinterpret_cast<char*>(object) + 4096, size_class.size - 4096, MADV_DONTNEED);
+			if (object == last) {
+				break;
+			}
+		}
+	}
+	last->next = size_class.free_list.head;
+	size_class.free_list.head = first;
+	size_class.free_list.count += count;
+	size_class.central_free.store(size_class.free_list.count * size_class.size, std::memory_order_relaxed);
+}
+
+void* SlabAllocator::alloc(size_t size)
+{
+	if (size > MAX_SIZE) {
+		large_in_use_.fetch_add(size, std::memory_order_relaxed);
+		return ::operator new(size);
+	}
+	size_t index = class_of(size);
+	ThreadCache& cache = thread_cache();
+	FreeList& list = cache.lists[index];
+	if (list.head == nullptr) {
+		refill(index, list);
+	}
+	FreeObject* object = list.head;
+	list.head = object->next;
+	list.count--;
+	cache.cached[index].store(list.count, std::memory_order_relaxed);
+	return object;
+}
+
+void SlabAllocator::free(void* ptr, size_t size)
+{
+	if (ptr == nullptr) {
+		return;
+	}
+	if (size > MAX_SIZE) {
+		large_in_use_.fetch_sub(size, std::memory_order_relaxed);
+		::operator delete(ptr);
+		return;
+	}
+	size_t index = class_of(size);
+	ThreadCache& cache = thread_cache();
+	FreeList& list = cache.lists[index];
+	FreeObject* object = static_cast<FreeObject*>(ptr);
+	object->next = list.head;
+	list.head = object;
+	list.count++;
+	if (list.count >= classes_[index].batch * 2) {
+		drain(index, list, classes_[index].batch);
+	}
+	cache.cached[index].store(list.count, std::memory_order_relaxed);
+}
+
+void SlabAllocator::register_cache(ThreadCache* cache)
+{
+	std::unique_lock<std::mutex> lock(caches_mutex_);
+	caches_.push_back(cache);
+}
+
+void SlabAllocator::unregister_cache(ThreadCache* cache)
+{
+	std::unique_lock<std::mutex> lock(caches_mutex_);
+	for (auto it = caches_.begin(); it != caches_.end(); ++it) {
+		if (*it == cache) {
+			caches_.erase(it);
+			break;
+		}
+	}
+}
+
+// 使用中 = 已保留 - 中心空闲 - 各线程缓存, 统计与分配并发进行, 结果是近似值
+SlabAllocator::Stats SlabAllocator::stats()
+{
+	Stats stats{0, 0, large_in_use_.load(std::memory_order_relaxed)};
+	uint64_t cached = 0;
+	{
+		std::unique_lock<std::mutex> lock(caches_mutex_);
+		for (ThreadCache* cache : caches_) {
+			for (size_t i = 0; i < CLASS_COUNT; i++) {
+				cached += cache->cached[i].load(std::memory_order_relaxed) * classes_[i].size;
+			}
+		}
+	}
+	uint64_t central = 0;
+	for (auto& size_class : classes_) {
+		stats.reserved += size_class.reserved.load(std::memory_order_relaxed);
+		central += size_class.central_free.load(std::memory_order_relaxed);
+	}
+	stats.in_use = stats.reserved > central + cached ? stats.reserved - central - cached : 0;
+	return stats;
+}
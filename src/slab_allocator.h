@@ -0,0 +1,112 @@
+#ifndef SLAB_ALLOCATOR_H
+#define SLAB_ALLOCATOR_H
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// 按大小分级的 slab 分配器, 用于 MemoryFile, 目录项节点, 基数树节点和 64KiB 数据块
+// 每级从 mmap 得到的 slab 中切出等大的对象, 空闲对象串成侵入式链表;
+// 每个线程缓存每级最多两批空闲对象, 常见路径的分配和释放不加锁, 只在批量换入换出时取该级的锁
+// 超过 MAX_SIZE 的请求直接交给 operator new
+class SlabAllocator
+{
+  public:
+	static constexpr size_t CLASS_COUNT = 20;
+	static constexpr size_t MAX_SIZE = 65536;
+	// 中心空闲链表中大于一页的对象超过该值时用 MADV_DONTNEED 把物理页还给系统
+	static constexpr size_t RELEASE_THRESHOLD = 64 * 1024 * 1024;
+	struct Stats {
+		uint64_t in_use;
+		uint64_t reserved;
+		uint64_t large_in_use;
+	};
+	static SlabAllocator& instance();
+	void* alloc(size_t size);
+	void free(void* ptr, size_t size);
+	Stats stats();
+
+  private:
+	struct FreeObject {
+		FreeObject* next;
+	};
+	struct FreeList {
+		FreeObject* head = nullptr;
+		size_t count = 0;
+	};
+	struct alignas(64) SizeClass {
+		size_t size = 0;
+		size_t batch = 0;
+		size_t slab_size = 0;
+		std::mutex mutex;
+		FreeList free_list;
+		std::atomic<uint64_t> reserved{0};
+		std::atomic<uint64_t> central_free{0};
+	};
+	struct ThreadCache;
+	SlabAllocator();
+	static size_t class_of(size_t size);
+	ThreadCache& thread_cache();
+	void refill(size_t index, FreeList& list);
+	void drain(size_t index, FreeList& list, size_t count);
+	void register_cache(ThreadCache* cache);
+	void unregister_cache(ThreadCache* cache);
+	std::array<SizeClass, CLASS_COUNT> classes_;
+	std::mutex caches_mutex_;
+	std::vector<ThreadCache*> caches_;
+	std::atomic<uint64_t> large_in_use_{0};
+};
+
+inline void* slab_alloc(size_t size)
+{
+	return SlabAllocator::instance().alloc(size);
+}
+
+inline void slab_free(void* ptr, size_t size)
+{
+	SlabAllocator::instance().free(ptr, size);
+}
+
+// 继承后该类型的 new/delete 走 slab 分配器
+struct SlabObject {
+	static void* operator new(size_t size)
+	{
+		return slab_alloc(size);
+	}
+	static void operator delete(void* ptr, size_t size)
+	{
+		slab_free(ptr, size);
+	}
+};
+
+// 供 std::allocate_shared 和容器使用的分配器
+template <typename T>
+struct SlabStlAllocator {
+	using value_type = T;
+	SlabStlAllocator() noexcept = default;
+	template <typename U>
+	SlabStlAllocator(const SlabStlAllocator<U>&) noexcept
+	{
+	}
+	T* allocate(size_t n)
+	{
+		return static_cast<T*>(slab_alloc(n * sizeof(T)));
+	}
+	void deallocate(T* ptr, size_t n) noexcept
+	{
+		slab_free(ptr, n * sizeof(T));
+	}
+	template <typename U>
+	bool operator==(const SlabStlAllocator<U>&) const noexcept
+	{
+		return true;
+	}
+	template <typename U>
+	bool operator!=(const SlabStlAllocator<U>&) const noexcept
+	{
+		return false;
+	}
+};
+#endif
@@ -0,0 +1,554 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "mem_fs.h"
+
+using std::shared_lock;
+using std::shared_mutex;
+using std::unique_lock;
+
+static const char IMAGE_MAGIC[8] = {'M', 'E', 'M', 'F', 'S', 'I', 'M', 'G'};
+static constexpr uint32_t IMAGE_VERSION = 1;
+// 按块对齐, 页大小不超过 64KiB 的机器上每个文件的内容都能单独映射和解除映射
+static constexpr uint64_t IMAGE_ALIGN = FileData::CHUNK_SIZE;
+static constexpr unsigned int CHECK_STATX_MASK = STATX_TYPE | STATX_SIZE | STATX_MTIME;
+// 恢复时每批检查的路径数
+static constexpr size_t CHECK_BATCH = 4096;
+
+// 同时只写一个镜像
+static std::mutex save_mutex;
+
+static uint64_t align_up(uint64_t value)
+{
+	return (value + IMAGE_ALIGN - 1) & ~(IMAGE_ALIGN - 1);
+}
+
+static int64_t mtime_ns(const struct statx& stx)
+{
+	return stx.stx_mtime.tv_sec * 1000000000LL + stx.stx_mtime.tv_nsec;
+}
+
+struct ImageWriter {
+	int fd = -1;
+	uint64_t data_end = IMAGE_ALIGN;
+	uint64_t data_bytes = 0;
+	std::vector<ImageEntry> entries;
+	std::string strings;
+	std::vector<struct iovec> iov;
+	std::vector<IoSpan> spans;
+};
+
+// 子项还没写入镜像的目录, target 为其在 target 中对应的路径
+struct PendingDir {
+	uint64_t index;
+	MemoryFilePtr dir;
+	std::string target;
+};
+
+// 追加以 '\0' 结尾的字符串, 返回在 strings 中的偏移
+static uint64_t add_string(ImageWriter& writer, const std::string& str)
+{
+	uint64_t offset = writer.strings.size();
+	writer.strings.append(str);
+	writer.strings.push_back('\0');
+	return offset;
+}
+
+static int32_t write_full(int fd, const void* buf, size_t len, uint64_t offset)
+{
+	const char* p = static_cast<const char*>(buf);
+	while (len > 0) {
+		ssize_t n = pwrite(fd, p, len, offset);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -errno;
+		}
+		p += n;
+		len -= n;
+		offset += n;
+	}
+	return 0;
+}
+
+// pwritev 可能只写一部分, iov 会被修改
+static int32_t writev_full(int fd, struct iovec* iov, int count, uint64_t offset)
+{
+	while (count > 0) {
+		ssize_t n = pwritev(fd, iov, count, offset);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -errno;
+		}
+		offset += n;
+		while (n > 0) {
+			size_t len = std::min<size_t>(n, iov->iov_len);
+			iov->iov_base = static_cast<char*>(iov->iov_base) + len;
+			iov->iov_len -= len;
+			n -= len;
+			if (iov->iov_len == 0) {
+				iov++;
+				count--;
+			}
+		}
+	}
+	return 0;
+}
+
+// 记录 path 在 target 中的状态, 恢复前据此检查
+static void stat_target(ImageEntry& entry, const std::string& path)
+{
+	struct statx stx;
+	if (statx(AT_FDCWD, path.c_str(), AT_STATX_DONT_SYNC, CHECK_STATX_MASK, &stx) == 0) {
+		entry.flags |= ENTRY_CHECK;
+		entry.target_mtime_ns = mtime_ns(stx);
+		entry.target_size = stx.stx_size;
+	} else if (errno == ENOENT) {
+		entry.flags |= ENTRY_CHECK | ENTRY_ABSENT;
+	}
+}
+
+// 把 [0, size) 中有数据的区段写到镜像的 offset 处, 空洞跳过
+static int32_t write_data(ImageWriter& writer, const FileData& data, uint64_t size, uint64_t offset)
+{
+	uint64_t pos = data.next_data(0);
+	while (pos != FileData::NO_DATA && pos < size) {
+		uint64_t end = std::min(data.next_hole(pos), size);
+		writer.iov.clear();
+		writer.spans.clear();
+		data.map_read(pos, end - pos, writer.iov);
+		split_iov(writer.iov, 0, offset + pos, writer.spans);
+		for (const auto& span : writer.spans) {
+			int32_t ret = writev_full(writer.fd, writer.iov.data() + span.first, span.count, span.offset);
+			if (ret != 0) {
+				return ret;
+			}
+		}
+		pos = data.next_data(end);
+	}
+	return 0;
+}
+
+// 返回持有的读锁, 此时文件中没有压缩块
+static shared_lock<shared_mutex> lock_uncompressed(const MemoryFilePtr& file)
+{
+	shared_lock<shared_mutex> lock(file->rw_mutex);
+	while (file->load_state == LoadState::LOADED && file->data.has_compressed(0, file->size)) {
+		lock.unlock();
+		{
+			unique_lock<shared_mutex> write_lock(file->rw_mutex);
+			if (file->load_state == LoadState::LOADED) {
+				file->data.decompress_range(0, file->size);
+				file->compress_done = false;
+			}
+		}
+		lock.lock();
+	}
+	return lock;
+}
+
+static ImageEntry make_entry(ImageWriter& writer, uint64_t parent, const std::string& name)
+{
+	ImageEntry entry = {};
+	entry.parent = parent;
+	entry.name_offset = add_string(writer, name);
+	entry.name_len = name.size();
+	return entry;
+}
+
+static void add_dir(ImageWriter& writer,
+					uint64_t parent,
+					const std::string& name,
+					const MemoryFilePtr& dir,
+					const std::string& target,
+					std::deque<PendingDir>& pending)
+{
+	ImageEntry entry = make_entry(writer, parent, name);
+	std::string path;
+	{
+		shared_lock<shared_mutex> lock(dir->rw_mutex);
+		entry.mode = dir->mode;
+		entry.size = dir->size;
+		entry.mtime = dir->mtime;
+		entry.ctime = dir->ctime;
+		entry.atime = dir->atime;
+		if (dir->is_init || dir->local_path.empty()) {
+			entry.flags |= ENTRY_LOADED_DIR;
+			path = target;
+		} else {
+			// 第一次访问时再扫描, 不需要检查
+			path = dir->local_path;
+		}
+	}
+	if (entry.flags & ENTRY_LOADED_DIR) {
+		// 子项在这之后才读取: 之后回写新增或删除文件会改变目录的 mtime, 恢复时能发现
+		if (!target.empty()) {
+			stat_target(entry, target);
+		}
+		pending.push_back({writer.entries.size(), dir, target});
+	}
+	entry.path_offset = add_string(writer, path);
+	entry.path_len = path.size();
+	writer.entries.push_back(entry);
+}
+
+// target 为文件在 target 中应在的路径, 没有 target 目录时为空
+static int32_t add_file(ImageWriter& writer,
+						uint64_t parent,
+						const std::string& name,
+						const MemoryFilePtr& file,
+						const std::string& target)
+{
+	ImageEntry entry = make_entry(writer, parent, name);
+	std::string local_path;
+	{
+		shared_lock<shared_mutex> lock(file->rw_mutex);
+		local_path = file->local_path;
+	}
+	// 先记录 target 再复制内容: 之间的修改写回后会改变 target 的 mtime, 恢复时能发现
+	ImageEntry checked = {};
+	if (!local_path.empty()) {
+		stat_target(checked, local_path);
+	}
+	shared_lock<shared_mutex> lock = lock_uncompressed(file);
+	entry.mode = file->mode;
+	entry.size = file->size;
+	entry.mtime = file->mtime;
+	entry.ctime = file->ctime;
+	entry.atime = file->atime;
+	entry.path_offset = add_string(writer, file->local_path);
+	entry.path_len = file->local_path.size();
+	if (!file->local_path.empty() && !target.empty() && file->local_path != target) {
+		entry.flags |= ENTRY_MOVED;
+	}
+	bool loaded = file->load_state == LoadState::LOADED;
+	if (loaded && S_ISREG(file->mode) && file->size > 0) {
+		entry.flags |= ENTRY_DATA;
+		entry.data_offset = writer.data_end;
+		int32_t ret = write_data(writer, file->data, file->size, entry.data_offset);
+		if (ret != 0) {
+			return ret;
+		}
+		writer.data_end += align_up(file->size);
+		writer.data_bytes += file->size;
+	}
+	if (loaded && (file->need_flush || file->writeback_queued || file->local_path != local_path)) {
+		entry.flags |= ENTRY_DIRTY;
+	} else if (!local_path.empty()) {
+		entry.flags |= checked.flags;
+		entry.target_mtime_ns = checked.target_mtime_ns;
+		entry.target_size = checked.target_size;
+	}
+	writer.entries.push_back(entry);
+	return 0;
+}
+
+static int32_t write_image(ImageWriter& writer)
+{
+	std::deque<PendingDir> pending;
+	add_dir(writer, 0, "/", inodes.get(InodeTable::ROOT_INO), real_path_perfix, pending);
+	std::vector<std::pair<std::string, uint64_t>> children;
+	while (!pending.empty()) {
+		PendingDir dir = std::move(pending.front());
+		pending.pop_front();
+		children.clear();
+		{
+			shared_lock<shared_mutex> lock(dir.dir->rw_mutex);
+			if (dir.dir->children != nullptr) {
+				children.assign(dir.dir->children->begin(), dir.dir->children->end());
+			}
+		}
+		for (const auto& child : children) {
+			MemoryFilePtr file = inodes.get(child.second);
+			if (file == nullptr) {
+				continue;
+			}
+			std::string target = dir.target.empty() ? "" : dir.target + "/" + child.first;
+			if (S_ISDIR(file->mode)) {
+				add_dir(writer, dir.index, child.first, file, target, pending);
+				continue;
+			}
+			int32_t ret = add_file(writer, dir.index, child.first, file, target);
+			if (ret != 0) {
+				return ret;
+			}
+		}
+	}
+
+	ImageHeader header = {};
+	memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+	header.version = IMAGE_VERSION;
+	header.entry_size = sizeof(ImageEntry);
+	header.entry_count = writer.entries.size();
+	header.target_offset = add_string(writer, real_path_perfix);
+	header.target_len = real_path_perfix.size();
+	header.table_offset = align_up(writer.data_end);
+	header.strings_offset = header.table_offset + writer.entries.size() * sizeof(ImageEntry);
+	header.strings_size = writer.strings.size();
+	header.image_size = header.strings_offset + header.strings_size;
+	header.created = time(nullptr);
+	int32_t ret =
+		write_full(writer.fd, writer.entries.data(), writer.entries.size() * sizeof(ImageEntry), header.table_offset);
+	if (ret == 0) {
+		ret = write_full(writer.fd, writer.strings.data(), writer.strings.size(), header.strings_offset);
+	}
+	if (ret == 0) {
+		ret = write_full(writer.fd, &header, sizeof(header), 0);
+	}
+	return ret;
+}
+
+int32_t save_snapshot(const std::string& image)
+{
+	std::lock_guard<std::mutex> save_lock(save_mutex);
+	auto start = std::chrono::steady_clock::now();
+	std::string tmp = image + ".tmp";
+	ImageWriter writer;
+	writer.fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (writer.fd < 0) {
+		int32_t ret = -errno;
+		LOGE("create snapshot %s fail, ret is %d\n", tmp.c_str(), ret);
+		return ret;
+	}
+	int32_t ret = write_image(writer);
+	if (ret == 0 && fsync(writer.fd) != 0) {
+		ret = -errno;
+	}
+	close(writer.fd);
+	// 正在使用的旧镜像被替换后, 已有的映射仍指向旧文件
+	if (ret == 0 && rename(tmp.c_str(), image.c_str()) != 0) {
+		ret = -errno;
+	}
+	if (ret != 0) {
+		LOGE("write snapshot %s fail, ret is %d\n", image.c_str(), ret);
+		unlink(tmp.c_str());
+		return ret;
+	}
+	LOGI("snapshot %s written: %zu entries, %lu MB data in %.2f s\n",
+		 image.c_str(),
+		 writer.entries.size(),
+		 writer.data_bytes >> 20,
+		 std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	return 0;
+}
+
+// 检查镜像结构: 偏移都在镜像内, 字符串以 '\0' 结尾, 父目录在子项之前, 各文件的内容区按顺序互不重叠
+static bool check_image(const char* base, uint64_t size)
+{
+	const auto* header = reinterpret_cast<const ImageHeader*>(base);
+	if (memcmp(header->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0 || header->version != IMAGE_VERSION
+		|| header->entry_size != sizeof(ImageEntry) || header->image_size != size) {
+		return false;
+	}
+	if (header->table_offset < IMAGE_ALIGN || header->table_offset % IMAGE_ALIGN != 0 || header->table_offset > size
+		|| header->entry_count == 0 || header->entry_count > (size - header->table_offset) / sizeof(ImageEntry)
+		|| header->strings_offset != header->table_offset + header->entry_count * sizeof(ImageEntry)
+		|| header->strings_size != size - header->strings_offset) {
+		return false;
+	}
+	const char* strings = base + header->strings_offset;
+	auto valid_string = [strings, header](uint64_t offset, uint64_t len) {
+		return offset < header->strings_size && len < header->strings_size - offset && strings[offset + len] == '\0';
+	};
+	if (!valid_string(header->target_offset, header->target_len)) {
+		return false;
+	}
+	const auto* entries = reinterpret_cast<const ImageEntry*>(base + header->table_offset);
+	uint64_t data_end = IMAGE_ALIGN;
+	for (uint64_t i = 0; i < header->entry_count; i++) {
+		const ImageEntry& entry = entries[i];
+		if (!valid_string(entry.name_offset, entry.name_len) || !valid_string(entry.path_offset, entry.path_len)) {
+			return false;
+		}
+		if (i == 0 ? !S_ISDIR(entry.mode)
+				   : entry.parent >= i || !S_ISDIR(entries[entry.parent].mode)
+						 || !(entries[entry.parent].flags & ENTRY_LOADED_DIR) || entry.name_len == 0
+						 || memchr(strings + entry.name_offset, '/', entry.name_len) != nullptr) {
+			return false;
+		}
+		if (entry.flags & ENTRY_DATA) {
+			if (!S_ISREG(entry.mode) || entry.data_offset < data_end || entry.data_offset % IMAGE_ALIGN != 0
+				|| entry.data_offset > header->table_offset || entry.size > header->table_offset - entry.data_offset) {
+				return false;
+			}
+			data_end = entry.data_offset + align_up(entry.size);
+		}
+	}
+	return true;
+}
+
+static bool target_unchanged(const ImageEntry& entry, int32_t ret, const struct statx& stx)
+{
+	if (entry.flags & ENTRY_ABSENT) {
+		return ret == -ENOENT;
+	}
+	return ret == 0 && (stx.stx_mode & S_IFMT) == (entry.mode & S_IFMT) && mtime_ns(stx) == entry.target_mtime_ns
+		   && (!S_ISREG(entry.mode) || stx.stx_size == entry.target_size);
+}
+
+// 检查快照记录的 target 路径都没有变化, 有变化时返回 false, changed 为第一个变化的路径
+// 有 io_uring 时每批 statx 一起提交, 失败的项(例如内核不支持 IORING_OP_STATX)再逐个重试
+static bool check_target(const ImageEntry* entries, uint64_t count, const char* strings, std::string& changed)
+{
+	std::vector<uint64_t> checks;
+	for (uint64_t i = 0; i < count; i++) {
+		if (entries[i].flags & ENTRY_CHECK) {
+			checks.push_back(i);
+		}
+	}
+	std::vector<struct statx> stx(std::min(CHECK_BATCH, checks.size()));
+	std::vector<int32_t> rets(stx.size());
+	IoRing* ring = thread_io_ring();
+	for (size_t first = 0; first < checks.size(); first += CHECK_BATCH) {
+		size_t n = std::min(CHECK_BATCH, checks.size() - first);
+		if (ring != nullptr) {
+			for (size_t i = 0; i < n; i++) {
+				ring->statx(AT_FDCWD,
+							strings + entries[checks[first + i]].path_offset,
+							AT_STATX_DONT_SYNC,
+							CHECK_STATX_MASK,
+							&stx[i],
+							[&rets, i](int32_t res) { rets[i] = res; });
+			}
+			if (ring->wait_all() != 0) {
+				// ring 已关闭, 之后都用阻塞 statx
+				ring = nullptr;
+			}
+		}
+		for (size_t i = 0; i < n; i++) {
+			const ImageEntry& entry = entries[checks[first + i]];
+			const char* path = strings + entry.path_offset;
+			if (ring == nullptr || rets[i] != 0) {
+				rets[i] = statx(AT_FDCWD, path, AT_STATX_DONT_SYNC, CHECK_STATX_MASK, &stx[i]) == 0 ? 0 : -errno;
+			}
+			if (!target_unchanged(entry, rets[i], stx[i])) {
+				changed = path;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+MemoryFilePtr restore_snapshot(const std::string& image)
+{
+	auto start = std::chrono::steady_clock::now();
+	int fd = open(image.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		LOGI("snapshot %s not opened, errno is %d, scan target\n", image.c_str(), errno);
+		return nullptr;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < IMAGE_ALIGN) {
+		close(fd);
+		LOGE("snapshot %s is broken, scan target\n", image.c_str());
+		return nullptr;
+	}
+	uint64_t size = st.st_size;
+	void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		LOGE("mmap snapshot %s fail, errno is %d, scan target\n", image.c_str(), errno);
+		return nullptr;
+	}
+	const char* base = static_cast<const char*>(map);
+	if (!check_image(base, size)) {
+		LOGE("snapshot %s is broken, scan target\n", image.c_str());
+		munmap(map, size);
+		return nullptr;
+	}
+	const auto* header = reinterpret_cast<const ImageHeader*>(base);
+	const auto* entries = reinterpret_cast<const ImageEntry*>(base + header->table_offset);
+	const char* strings = base + header->strings_offset;
+	uint64_t count = header->entry_count;
+	uint64_t table_offset = header->table_offset;
+	if (real_path_perfix != std::string(strings + header->target_offset, header->target_len)) {
+		LOGI("snapshot %s was taken for target %s, scan target\n", image.c_str(), strings + header->target_offset);
+		munmap(map, size);
+		return nullptr;
+	}
+	std::string changed;
+	if (!check_target(entries, count, strings, changed)) {
+		LOGI("snapshot %s is stale, %s changed after it was taken, scan target\n", image.c_str(), changed.c_str());
+		munmap(map, size);
+		return nullptr;
+	}
+
+	time_t now = time(nullptr);
+	uint64_t data_bytes = 0;
+	std::vector<MemoryFilePtr> files(count);
+	for (uint64_t i = 0; i < count; i++) {
+		const ImageEntry& entry = entries[i];
+		MemoryFilePtr file = make_memory_file();
+		file->name = i == 0 ? "/" : std::string(strings + entry.name_offset, entry.name_len);
+		file->mode = entry.mode;
+		file->size = entry.size;
+		file->mtime = entry.mtime;
+		file->ctime = entry.ctime;
+		file->atime = entry.atime;
+		std::string path(strings + entry.path_offset, entry.path_len);
+		if (S_ISDIR(entry.mode)) {
+			if (entry.flags & ENTRY_LOADED_DIR) {
+				file->is_init = true;
+			} else {
+				file->local_path = std::move(path);
+			}
+		} else {
+			if (entry.flags & ENTRY_DATA) {
+				// 映射到镜像中自己的内容区, 解除映射时只解除这一段
+				file->data.attach_mapping(base + entry.data_offset, entry.size, align_up(entry.size));
+				data_bytes += entry.size;
+			} else if (S_ISREG(entry.mode) && !path.empty()) {
+				file->load_state = LoadState::NOT_LOADED;
+			}
+			if (entry.flags & ENTRY_DIRTY) {
+				// 从空文件开始整个重新回写
+				file->dirty.add(0, entry.size);
+				file->shrink_size = 0;
+				file->need_flush = true;
+				file->dirty_since = now;
+			}
+			if (entry.flags & ENTRY_MOVED) {
+				file->need_flush = true;
+				file->dirty_since = now;
+			}
+			file->local_path = std::move(path);
+		}
+		inodes.insert(file);
+		if (entry.flags & ENTRY_MOVED) {
+			writeback.add_move(file->local_path, file->ino);
+		}
+		if (i > 0) {
+			const MemoryFilePtr& parent = files[entry.parent];
+			file->parent = parent->ino;
+			if (parent->children == nullptr) {
+				parent->children = new ChildMap();
+			}
+			(*parent->children)[file->name] = file->ino;
+		}
+		files[i] = std::move(file);
+	}
+	// 文件内容之外的部分不再需要
+	munmap(map, IMAGE_ALIGN);
+	munmap(const_cast<char*>(base) + table_offset, size - table_offset);
+	LOGI("restored %lu entries, %lu MB data from snapshot %s in %.2f s\n",
+		 count,
+		 data_bytes >> 20,
+		 image.c_str(),
+		 std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	return files[0];
+}
@@ -0,0 +1,78 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include <cstdint>
+#include <string>
+
+#include "mem_fs_file.h"
+
+// 快照镜像的路径, 为空时不使用. 应放在 target 之外
+// 启动时镜像存在且与 target 一致则直接从镜像恢复目录树, 不再扫描 target; 正常退出时和 MEMFS_IOC_SNAPSHOT 时写入
+// 恢复后文件内容映射自镜像, 挂载期间镜像不能被其他进程修改(memfs 自己写新镜像时用 rename 替换, 不影响已有映射)
+struct SnapshotConfig {
+	std::string path;
+};
+
+/*
+ * 镜像格式(本机字节序, 只给同一台机器上的 memfs 用):
+ *  - [0, CHUNK_SIZE): ImageHeader
+ *  - [CHUNK_SIZE, table_offset): 文件内容, 每个文件从 CHUNK_SIZE 对齐处开始占 size 向上取整到 CHUNK_SIZE 的空间,
+ *    文件中的空洞在镜像中也是空洞
+ *  - table_offset: entry_count 个 ImageEntry, 父目录总在子项之前, 第 0 项是根目录
+ *  - strings_offset: 文件名和路径, 每个都以 '\0' 结尾
+ * 恢复时整个镜像只映射一次, 每个文件的内容作为该文件的私有只读映射(与 --mmap 加载的文件相同), 写时才拷贝
+ */
+struct ImageHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_size;
+	uint64_t entry_count;
+	uint64_t table_offset;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+	uint64_t image_size;
+	// 拍快照时的 target 目录, 在 strings 中
+	uint64_t target_offset;
+	uint64_t target_len;
+	int64_t created;
+};
+
+enum ImageEntryFlag : uint32_t {
+	// 目录的子项都在镜像中; 否则 path 是第一次访问时要扫描的 target 目录
+	ENTRY_LOADED_DIR = 1 << 0,
+	// 内容在镜像中
+	ENTRY_DATA = 1 << 1,
+	// 内容还没写回 target, 恢复后整个文件重新回写
+	ENTRY_DIRTY = 1 << 2,
+	// 恢复前检查 path 在 target 中的类型和 mtime(普通文件还有大小)与快照时相同
+	ENTRY_CHECK = 1 << 3,
+	// 快照时 path 不存在, 恢复前检查仍不存在
+	ENTRY_ABSENT = 1 << 4,
+	// 文件被 rename 过, 内容还在 target 的 path 中没有移到新路径, 恢复后由回写移过去
+	ENTRY_MOVED = 1 << 5,
+};
+
+struct ImageEntry {
+	uint64_t parent;
+	uint64_t name_offset;
+	uint64_t name_len;
+	// 文件: local_path; 已加载的目录: target 中对应的路径(只用于检查); 未加载的目录: 要扫描的 target 路径
+	uint64_t path_offset;
+	uint64_t path_len;
+	uint32_t mode;
+	uint32_t flags;
+	uint64_t size;
+	int64_t mtime;
+	int64_t ctime;
+	int64_t atime;
+	int64_t target_mtime_ns;
+	uint64_t target_size;
+	uint64_t data_offset;
+};
+
+// 把当前目录树写成镜像: 先写临时文件, 完成后 rename 覆盖 image, 成功返回 0, 失败返回 -errno
+// 没加载的文件只记录元数据, 恢复后仍从 target 懒加载; 还没写回的文件内容也写入镜像
+int32_t save_snapshot(const std::string& image);
+// 从镜像恢复目录树并返回根目录, 必须在 inode 表为空时调用
+// 镜像不存在, 损坏, 不是同一 target 的, 或 target 在快照后被修改过时返回 nullptr, 调用者改为扫描 target
+MemoryFilePtr restore_snapshot(const std::string& image);
+#endif
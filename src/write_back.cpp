@@ -0,0 +1,606 @@
+#include "write_back.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "mem_fs.h"
+
+namespace fs = std::filesystem;
+
+WriteBack::Batch::~Batch()
+{
+	for (char* chunk : chunks) {
+		slab_free(chunk, FileData::CHUNK_SIZE);
+	}
+}
+
+WriteBack::~WriteBack()
+{
+	stop();
+	for (auto& entry : files_) {
+		close(entry.second.fd);
+	}
+}
+
+int WriteBack::start(const WriteBackConfig& config)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (running_) {
+		return 0;
+	}
+	config_ = config;
+	running_ = true;
+	for (unsigned int i = 0; i < std::max(config_.threads, 1u); i++) {
+		threads_.emplace_back(&WriteBack::io_loop, this);
+	}
+	flush_thread_ = std::thread(&WriteBack::flush_loop, this);
+	return 0;
+}
+
+int WriteBack::stop()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!running_) {
+		return 0;
+	}
+	running_ = false;
+	lock.unlock();
+	cond_.notify_all();
+	flush_cond_.notify_all();
+	clean_cond_.notify_all();
+	flush_thread_.join();
+	for (auto& thread : threads_) {
+		thread.join();
+	}
+	threads_.clear();
+	return 0;
+}
+
+void WriteBack::schedule(const MemoryFilePtr& file)
+{
+	{
+		std::unique_lock<std::shared_mutex> file_lock(file->rw_mutex);
+		if (file->writeback_queued) {
+			return;
+		}
+		file->writeback_queued = true;
+	}
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (running_) {
+		queue_.push_back(file);
+		cond_.notify_one();
+		return;
+	}
+	lock.unlock();
+	while (write_file(file) > 0) {
+	}
+}
+
+int WriteBack::throttle()
+{
+	uint64_t dirty = DirtyExtents::total_bytes();
+	if (dirty < config_.background_bytes) {
+		return 0;
+	}
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!running_) {
+		return 0;
+	}
+	if (!kicked_) {
+		kicked_ = true;
+		flush_cond_.notify_one();
+	}
+	if (dirty < config_.limit_bytes) {
+		return 0;
+	}
+	throttled_++;
+	auto begin = std::chrono::steady_clock::now();
+	int ret = 0;
+	// 脏字节数的减少不会逐次通知, 所以定期重新检查; 上一次扫描之后才变脏的文件需要再次唤醒扫描
+	while (running_ && DirtyExtents::total_bytes() >= config_.limit_bytes) {
+		ret = error_;
+		if (ret != 0) {
+			break;
+		}
+		if (!kicked_) {
+			kicked_ = true;
+			flush_cond_.notify_one();
+		}
+		clean_cond_.wait_for(lock, std::chrono::milliseconds(10));
+	}
+	throttled_ms_ += std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin)
+						 .count();
+	return ret;
+}
+
+int WriteBack::sync_file(const MemoryFilePtr& file, bool datasync)
+{
+	{
+		// 等正在进行的回写任务结束后由本线程接管, 保证写入顺序
+		std::unique_lock<std::shared_mutex> lock(file->rw_mutex);
+		idle_cond_.wait(lock, [&file] { return !file->writeback_queued; });
+		file->writeback_queued = true;
+	}
+	int ret;
+	while ((ret = write_file(file)) > 0) {
+	}
+	if (ret < 0) {
+		return ret;
+	}
+	std::string path = get_real_path(get_path_by_file(file));
+	mode_t mode;
+	{
+		std::shared_lock<std::shared_mutex> lock(file->rw_mutex);
+		if (file->unlinked) {
+			return 0;
+		}
+		mode = file->mode;
+	}
+	int fd = acquire_fd(file->ino, path, mode);
+	if (fd < 0) {
+		return fd;
+	}
+	ret = (datasync ? fdatasync(fd) : fsync(fd)) == 0 ? 0 : -errno;
+	release_fd(file->ino, fd);
+	syncs_++;
+	return ret;
+}
+
+void WriteBack::io_loop()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		cond_.wait(lock, [this] { return !running_ || !queue_.empty(); });
+		if (queue_.empty()) {
+			// 只有 stop 后队列已清空才会走到这里
+			return;
+		}
+		MemoryFilePtr file = std::move(queue_.front());
+		queue_.pop_front();
+		lock.unlock();
+		bool again = write_file(file) > 0;
+		lock.lock();
+		clean_cond_.notify_all();
+		if (again) {
+			// 放回队尾, 避免一个持续被写的大文件占住 I/O 线程
+			queue_.push_back(std::move(file));
+		}
+	}
+}
+
+void WriteBack::flush_loop()
+{
+	auto interval = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::duration<double>(std::max(config_.interval, 0.001)));
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (running_) {
+		bool kicked = flush_cond_.wait_for(lock, interval, [this] { return !running_ || kicked_; });
+		if (!running_) {
+			break;
+		}
+		lock.unlock();
+		// 脏数据超过后台阈值时不论变脏多久都写回
+		flush_files(kicked ? 0 : config_.max_dirty_age, true);
+		lock.lock();
+		if (kicked) {
+			// 每次扫描要遍历整个 inode 表, 限制被唤醒的频率; 扫描完再清除, 扫描期间的唤醒合并掉
+			flush_cond_.wait_for(lock, std::chrono::milliseconds(10), [this] { return !running_; });
+			kicked_ = false;
+		}
+	}
+}
+
+void WriteBack::finish_file(const MemoryFilePtr& file)
+{
+	file->writeback_queued = false;
+	idle_cond_.notify_all();
+}
+
+void WriteBack::write_failed(const MemoryFilePtr& file, const std::string& path, int ret)
+{
+	failures_++;
+	error_ = ret == -ENOSPC || ret == -EDQUOT ? ret : -EIO;
+	file->write_failures++;
+	time_t delay = std::min<time_t>(time_t(1) << std::min(file->write_failures - 1, 6u), MAX_RETRY_DELAY);
+	file->retry_after = time(nullptr) + delay;
+	LOGE("write back %s fail, ret is %d, retry in %ld s\n", path.c_str(), ret, static_cast<long>(delay));
+}
+
+void WriteBack::add_move(const std::string& from, uint64_t ino)
+{
+	std::unique_lock<std::mutex> lock(moves_mutex_);
+	moves_[from] = ino;
+}
+
+void WriteBack::remove_move(const std::string& from, uint64_t ino)
+{
+	std::unique_lock<std::mutex> lock(moves_mutex_);
+	auto it = moves_.find(from);
+	if (it != moves_.end() && it->second == ino) {
+		moves_.erase(it);
+	}
+}
+
+int WriteBack::release_path(const std::string& path, uint64_t ino)
+{
+	uint64_t owner;
+	{
+		std::unique_lock<std::mutex> lock(moves_mutex_);
+		auto it = moves_.find(path);
+		if (it == moves_.end() || it->second == ino) {
+			return 0;
+		}
+		owner = it->second;
+	}
+	// 例如两个文件互换了名字: 先移走的一方会覆盖另一方的原文件, 另一方只能读入内存后整个重写
+	MemoryFilePtr other = inodes.get(owner);
+	if (other != nullptr) {
+		int ret = load_file(other);
+		if (ret != 0) {
+			return ret;
+		}
+		std::unique_lock<std::shared_mutex> lock(other->rw_mutex);
+		if (other->local_path == path) {
+			std::string().swap(other->local_path);
+			other->dirty.add(0, other->size);
+			other->shrink_size = 0;
+			if (!other->need_flush) {
+				other->need_flush = true;
+				other->dirty_since = time(nullptr);
+			}
+		}
+	}
+	remove_move(path, owner);
+	return 0;
+}
+
+int WriteBack::move_file(const MemoryFilePtr& file, const std::string& path, uint64_t version)
+{
+	std::unique_lock<std::shared_mutex> lock(file->rw_mutex);
+	// 懒加载在锁外读取 local_path, 加载期间不能移走
+	while (file->load_state == LoadState::LOADING) {
+		lock.unlock();
+		load_file(file);
+		lock.lock();
+	}
+	if (file->unlinked || file->local_path.empty()) {
+		return 0;
+	}
+	if (path_version(file) != version) {
+		return -EAGAIN;
+	}
+	std::string from = file->local_path;
+	if (from == path) {
+		// rename 后又回到了原来的名字
+		remove_move(from, file->ino);
+		return 0;
+	}
+	// 只改 target 中的名字, 耗时与文件大小无关; 已有的映射和缓存的 fd 指向的 inode 不变
+	std::error_code ec;
+	fs::create_directories(fs::path(path).parent_path(), ec);
+	if (rename(from.c_str(), path.c_str()) == 0) {
+		file->local_path = path;
+		remove_move(from, file->ino);
+		renames_++;
+		return 0;
+	}
+	LOGW("rename %s to %s fail, errno is %d, rewrite whole file\n", from.c_str(), path.c_str(), errno);
+	lock.unlock();
+	int ret = load_file(file);
+	if (ret != 0) {
+		return ret;
+	}
+	lock.lock();
+	if (file->local_path == from) {
+		// 新路径上的文件与内存内容无关, 整个文件从空文件开始重新回写
+		std::string().swap(file->local_path);
+		file->dirty.add(0, file->size);
+		file->shrink_size = 0;
+	}
+	remove_move(from, file->ino);
+	return 0;
+}
+
+int WriteBack::write_file(const MemoryFilePtr& file)
+{
+	std::string path;
+	uint64_t version;
+	int ret;
+	do {
+		// 路径解析要获取父目录的锁, 必须在拿文件锁之前
+		version = path_version(file);
+		path = get_real_path(get_path_by_file(file));
+		bool active;
+		{
+			std::shared_lock<std::shared_mutex> lock(file->rw_mutex);
+			active = !file->unlinked && file->need_flush;
+		}
+		// 先把 target 中的原文件移到当前路径, 并且不能覆盖其他文件还没移走的原文件
+		ret = active ? release_path(path, file->ino) : 0;
+		if (ret == 0 && active) {
+			ret = move_file(file, path, version);
+		}
+	} while (ret == -EAGAIN);
+	Batch batch;
+	{
+		std::unique_lock<std::shared_mutex> lock(file->rw_mutex);
+		if (ret != 0) {
+			write_failed(file, path, ret);
+			finish_file(file);
+			return ret;
+		}
+		if (file->unlinked || !file->need_flush) {
+			finish_file(file);
+			lock.unlock();
+			if (file->unlinked) {
+				forget_fd(file->ino);
+			}
+			return 0;
+		}
+		batch.size = file->size;
+		batch.shrink_size = file->shrink_size;
+		file->shrink_size = UINT64_MAX;
+		batch.mode = file->mode;
+		file->dirty.take(BATCH_BYTES, batch.extents);
+		file->need_flush = !file->dirty.empty();
+		std::vector<struct iovec> iov;
+		uint64_t used = FileData::CHUNK_SIZE;
+		for (const auto& extent : batch.extents) {
+			iov.clear();
+			file->data.decompress_range(extent.first, extent.second - extent.first);
+			file->data.map_read(extent.first, extent.second - extent.first, iov);
+			for (const auto& piece : iov) {
+				size_t copied = 0;
+				while (copied < piece.iov_len) {
+					if (used == FileData::CHUNK_SIZE) {
+						batch.chunks.push_back(static_cast<char*>(slab_alloc(FileData::CHUNK_SIZE)));
+						used = 0;
+					}
+					size_t len = std::min<size_t>(piece.iov_len - copied, FileData::CHUNK_SIZE - used);
+					memcpy(batch.chunks.back() + used, static_cast<char*>(piece.iov_base) + copied, len);
+					copied += len;
+					used += len;
+				}
+			}
+		}
+	}
+
+	ret = write_batch(file->ino, path, batch);
+	std::unique_lock<std::shared_mutex> lock(file->rw_mutex);
+	if (ret != 0) {
+		// 把没写成功的区间放回去, 等下次定时回写再试; 期间被截断的部分丢弃
+		write_failed(file, path, ret);
+		for (const auto& extent : batch.extents) {
+			file->dirty.add(extent.first, extent.second);
+		}
+		file->dirty.truncate(file->size);
+		file->shrink_size = std::min(file->shrink_size, batch.shrink_size);
+		file->need_flush = true;
+		finish_file(file);
+		return ret;
+	}
+	if (file->write_failures != 0) {
+		file->write_failures = 0;
+		file->retry_after = 0;
+	}
+	error_ = 0;
+	if (batch.shrink_size == 0 && !file->unlinked && path_version(file) != version) {
+		// 写的时候文件被移走了, 写到的是旧路径, 到新路径重新整个写
+		file->dirty.add(0, file->size);
+		file->shrink_size = 0;
+		file->need_flush = true;
+	} else if (batch.shrink_size == 0 && !file->unlinked) {
+		// target 文件从空文件开始写, 写完后与内存内容一致, 之后可以从这里重新加载
+		file->local_path = path;
+	}
+	if (file->need_flush && !file->unlinked) {
+		return 1;
+	}
+	finish_file(file);
+	return 0;
+}
+
+// pwritev 可能只写一部分
+static int pwritev_full(int fd, struct iovec* iov, int count, uint64_t offset)
+{
+	while (count > 0) {
+		ssize_t n = pwritev(fd, iov, count, offset);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -errno;
+		}
+		offset += n;
+		while (n > 0) {
+			size_t len = std::min<size_t>(n, iov->iov_len);
+			iov->iov_base = static_cast<char*>(iov->iov_base) + len;
+			iov->iov_len -= len;
+			n -= len;
+			if (iov->iov_len == 0) {
+				iov++;
+				count--;
+			}
+		}
+	}
+	return 0;
+}
+
+int WriteBack::write_batch(uint64_t ino, const std::string& path, const Batch& batch)
+{
+	int fd = acquire_fd(ino, path, batch.mode, batch.shrink_size == 0);
+	if (fd < 0) {
+		return fd;
+	}
+	int ret = 0;
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		ret = -errno;
+	} else {
+		// 先截断到快照之间的最小大小, 再扩展到当前大小
+		uint64_t target_size = st.st_size;
+		if (batch.shrink_size < target_size) {
+			ret = ftruncate(fd, batch.shrink_size) == 0 ? 0 : -errno;
+			target_size = batch.shrink_size;
+		}
+		if (ret == 0 && target_size != batch.size && ftruncate(fd, batch.size) != 0) {
+			ret = -errno;
+		}
+	}
+	// 每个区间在快照缓冲区中的数据切成 iovec, 再按 IOV_MAX 分组
+	std::vector<struct iovec> iov;
+	std::vector<IoSpan> spans;
+	uint64_t pos = 0;
+	for (const auto& extent : batch.extents) {
+		uint64_t len = extent.second - extent.first;
+		size_t first = iov.size();
+		for (uint64_t off = pos; off < pos + len;) {
+			uint64_t in_chunk = off % FileData::CHUNK_SIZE;
+			size_t piece = std::min(FileData::CHUNK_SIZE - in_chunk, pos + len - off);
+			iov.push_back({batch.chunks[off / FileData::CHUNK_SIZE] + in_chunk, piece});
+			off += piece;
+		}
+		split_iov(iov, first, extent.first, spans);
+		pos += len;
+	}
+
+	IoRing* ring = ret == 0 ? thread_io_ring() : nullptr;
+	bool done = false;
+	if (ring != nullptr) {
+		// 所有区间一次提交, 有任何一个没写完整就整批用 pwritev 重写(重写同样的数据是幂等的)
+		bool failed = false;
+		for (const auto& span : spans) {
+			size_t len = span.len;
+			ring->writev(fd, iov.data() + span.first, span.count, span.offset, [&failed, len](int32_t res) {
+				if (res < 0 || static_cast<size_t>(res) != len) {
+					failed = true;
+				}
+			});
+		}
+		done = ring->wait_all() == 0 && !failed;
+	}
+	for (size_t i = 0; ret == 0 && !done && i < spans.size(); i++) {
+		ret = pwritev_full(fd, iov.data() + spans[i].first, spans[i].count, spans[i].offset);
+	}
+	if (ret == 0) {
+		writes_ += spans.size();
+		bytes_written_ += pos;
+	}
+	release_fd(ino, fd);
+	return ret;
+}
+
+int WriteBack::acquire_fd(uint64_t ino, const std::string& path, mode_t mode, bool recreate)
+{
+	std::unique_lock<std::mutex> lock(files_mutex_);
+	auto it = files_.find(ino);
+	if (it != files_.end() && it->second.path == path && !recreate) {
+		it->second.users++;
+		it->second.last_use = ++use_clock_;
+		return it->second.fd;
+	}
+	if (it != files_.end() && it->second.users == 0) {
+		close(it->second.fd);
+		files_.erase(it);
+	} else if (it != files_.end()) {
+		// 还在被使用的旧 fd 可能指向要重建的文件, 之后不再复用
+		it->second.path.clear();
+	}
+	// 淘汰最久未用且没有在用的 fd
+	while (files_.size() >= MAX_OPEN_FILES) {
+		auto victim = files_.end();
+		for (auto cur = files_.begin(); cur != files_.end(); ++cur) {
+			if (cur->second.users == 0 && (victim == files_.end() || cur->second.last_use < victim->second.last_use)) {
+				victim = cur;
+			}
+		}
+		if (victim == files_.end()) {
+			break;
+		}
+		close(victim->second.fd);
+		files_.erase(victim);
+	}
+	lock.unlock();
+
+	// 在内存中新建的目录在 target 中可能还不存在
+	std::error_code ec;
+	fs::create_directories(fs::path(path).parent_path(), ec);
+	if (recreate && unlink(path.c_str()) != 0 && errno != ENOENT) {
+		return -errno;
+	}
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, mode & 07777);
+	if (fd < 0) {
+		return -errno;
+	}
+	opens_++;
+	lock.lock();
+	it = files_.find(ino);
+	if (it != files_.end()) {
+		// 路径变化(rename)时旧 fd 还在被使用, 本次用完直接关闭新打开的 fd, 不放进缓存
+		if (it->second.users != 0) {
+			return fd;
+		}
+		close(it->second.fd);
+	}
+	BackingFile& entry = files_[ino];
+	entry.path = path;
+	entry.fd = fd;
+	entry.users = 1;
+	entry.last_use = ++use_clock_;
+	return fd;
+}
+
+void WriteBack::release_fd(uint64_t ino, int fd)
+{
+	std::unique_lock<std::mutex> lock(files_mutex_);
+	auto it = files_.find(ino);
+	if (it != files_.end() && it->second.fd == fd) {
+		it->second.users--;
+		return;
+	}
+	lock.unlock();
+	close(fd);
+}
+
+void WriteBack::forget_fd(uint64_t ino)
+{
+	std::unique_lock<std::mutex> lock(files_mutex_);
+	auto it = files_.find(ino);
+	if (it != files_.end() && it->second.users == 0) {
+		close(it->second.fd);
+		files_.erase(it);
+	}
+}
+
+void WriteBack::log_stats(LogLevel level)
+{
+	size_t open_files;
+	{
+		std::unique_lock<std::mutex> lock(files_mutex_);
+		open_files = files_.size();
+	}
+	log_message(level,
+				__FILE__,
+				__LINE__,
+				__func__,
+				"write back: %lu dirty bytes, %lu bytes in %lu writes, %lu fsyncs, %lu opens, %zu cached fds, "
+				"%lu renames, %lu failures, throttled %lu times for %lu ms\n",
+				DirtyExtents::total_bytes(),
+				bytes_written_.load(),
+				writes_.load(),
+				syncs_.load(),
+				opens_.load(),
+				open_files,
+				renames_.load(),
+				failures_.load(),
+				throttled_.load(),
+				throttled_ms_.load());
+}
@@ -0,0 +1,126 @@
+#ifndef WRITE_BACK_H
+#define WRITE_BACK_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "log_utils.h"
+#include "mem_fs_file.h"
+
+// 回写策略
+// 每 interval 秒检查一次, 变脏超过 max_dirty_age 秒的文件写回, max_dirty_age 为 0 时每次写回所有脏文件
+// 所有文件的脏数据超过 background_bytes 时提前写回全部脏文件, 超过 limit_bytes 时写入请求等待直到回落
+// 回写失败的文件等 1, 2, 4 ... 最多 MAX_RETRY_DELAY 秒后再由定时扫描重试
+struct WriteBackConfig {
+	unsigned int threads = 4;
+	double interval = 10.0;
+	double max_dirty_age = 0;
+	uint64_t background_bytes = 256ULL << 20;
+	uint64_t limit_bytes = 1ULL << 30;
+};
+
+// 把文件的脏区间写回 target 目录
+// 持有文件锁时只把最多 BATCH_BYTES 的脏数据拷贝出来(快照), 释放锁后再由 I/O 线程用 pwritev 写盘,
+// 写盘期间读写请求不受影响. 同一文件同时最多只有一个回写任务(writeback_queued), 保证先写的数据不会覆盖后写的数据
+// 未 start 时 schedule 在调用线程上同步回写
+class WriteBack
+{
+  public:
+	static constexpr uint64_t BATCH_BYTES = 8ULL << 20;
+	static constexpr size_t MAX_OPEN_FILES = 256;
+	static constexpr time_t MAX_RETRY_DELAY = 60;
+	~WriteBack();
+	// 启动 I/O 线程和按 config 定时扫描脏文件的线程
+	int start(const WriteBackConfig& config);
+	// 把队列中已有的任务做完后退出
+	int stop();
+	void schedule(const MemoryFilePtr& file);
+	// 写入前调用: 脏数据超过后台阈值时提前唤醒扫描, 超过上限时阻塞到回写使其回落
+	// 回写一直失败时脏数据不会回落, 此时不再等待, 返回 -ENOSPC/-EDQUOT 或 -EIO
+	int throttle();
+	// 同步写回该文件的全部脏数据并 fsync(datasync 时 fdatasync) target 文件, 失败返回 -errno
+	int sync_file(const MemoryFilePtr& file, bool datasync);
+	// 文件在内存中被 rename 后, target 中保存其内容的原文件 from 等回写时再 rename 到新路径;
+	// 移走之前其他文件回写到 from 时, 先把该文件读入内存改为整个重写. 调用者持有文件写锁
+	void add_move(const std::string& from, uint64_t ino);
+	// from 不再是该文件的内容来源(已移走, 文件被删除或改为整个重写)
+	void remove_move(const std::string& from, uint64_t ino);
+	void log_stats(LogLevel level);
+
+  private:
+	// 快照: 区间 [first, second) 的数据依次紧密存放在 chunks 中, 每块 FileData::CHUNK_SIZE 字节
+	struct Batch {
+		uint64_t size = 0;
+		uint64_t shrink_size = UINT64_MAX;
+		mode_t mode = 0;
+		std::vector<std::pair<uint64_t, uint64_t>> extents;
+		std::vector<char*> chunks;
+		~Batch();
+	};
+	// 缓存的 target 文件 fd, 按 inode 号索引; 文件被 rename 后路径变化时重新打开
+	struct BackingFile {
+		std::string path;
+		int fd = -1;
+		// 正在使用该 fd 的线程数, 不为 0 时不会被淘汰
+		int users = 0;
+		uint64_t last_use = 0;
+	};
+	void io_loop();
+	void flush_loop();
+	// 回写一批数据, 返回 1 表示文件还有脏数据需要再次排队, 0 表示已写完, 失败返回 -errno
+	int write_file(const MemoryFilePtr& file);
+	// 回写任务结束, 调用者持有文件写锁
+	void finish_file(const MemoryFilePtr& file);
+	// 回写失败时记下错误并推迟该文件的下次定时回写, 调用者持有文件写锁
+	void write_failed(const MemoryFilePtr& file, const std::string& path, int ret);
+	// 文件的 local_path 不是当前路径 path 时把 target 中的原文件 rename 过去, 失败时读入内容改为整个重写
+	// version 为解析 path 前的 path_version, 之后文件被 rename 过时返回 -EAGAIN, 需要重新解析路径
+	int move_file(const MemoryFilePtr& file, const std::string& path, uint64_t version);
+	// path 还是其他文件没移走的原文件时, 先把那个文件读入内存改为整个重写, 之后 path 可以被覆盖
+	int release_path(const std::string& path, uint64_t ino);
+	int write_batch(uint64_t ino, const std::string& path, const Batch& batch);
+	// recreate 时先删除 path 再新建, 不在原 inode 上截断重写: 被删除或 rename 走的文件可能还映射着原 inode
+	int acquire_fd(uint64_t ino, const std::string& path, mode_t mode, bool recreate = false);
+	// 用完 acquire_fd 得到的 fd, 不在缓存中的 fd 直接关闭
+	void release_fd(uint64_t ino, int fd);
+	void forget_fd(uint64_t ino);
+	WriteBackConfig config_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	// 定时扫描线程等待 interval 或被 throttle 唤醒
+	std::condition_variable flush_cond_;
+	bool kicked_ = false;
+	// 每批写完后唤醒被限流的写入者
+	std::condition_variable clean_cond_;
+	// 文件的回写任务结束时唤醒等待接管该文件的 sync_file
+	std::condition_variable_any idle_cond_;
+	bool running_ = false;
+	std::deque<MemoryFilePtr> queue_;
+	std::vector<std::thread> threads_;
+	std::thread flush_thread_;
+	std::mutex files_mutex_;
+	std::unordered_map<uint64_t, BackingFile> files_;
+	// 等待 rename 到新路径的原文件: target 中的路径 -> inode 号, moves_mutex_ 是叶子锁
+	std::mutex moves_mutex_;
+	std::unordered_map<std::string, uint64_t> moves_;
+	uint64_t use_clock_ = 0;
+	std::atomic<uint64_t> bytes_written_{0};
+	std::atomic<uint64_t> writes_{0};
+	std::atomic<uint64_t> opens_{0};
+	std::atomic<uint64_t> renames_{0};
+	std::atomic<uint64_t> failures_{0};
+	// 最近一次回写失败的错误, 之后有回写成功时清零
+	std::atomic<int> error_{0};
+	std::atomic<uint64_t> syncs_{0};
+	std::atomic<uint64_t> throttled_{0};
+	std::atomic<uint64_t> throttled_ms_{0};
+};
+#endif
@@ -5,6 +5,7 @@ echo "挂载 memory_fs..."
 mkdir -p "$SCRIPT_DIR/../mount_point"
 mkdir -p "$SCRIPT_DIR/../target_dir"
 # "$SCRIPT_DIR/../../build/memory_fs" "$SCRIPT_DIR/../mount_point" --target "$SCRIPT_DIR/../target_dir" --log_level debug -f &
-"$SCRIPT_DIR/../../build/memory_fs" "$SCRIPT_DIR/../mount_point" --target "$SCRIPT_DIR/../target_dir" &
+# 额外参数原样传给 memory_fs, 例如 bash mount.sh --max_threads 4
+"$SCRIPT_DIR/../../build/memory_fs" "$SCRIPT_DIR/../mount_point" --target "$SCRIPT_DIR/../target_dir" "$@" &
 sleep 2
 echo "FUSE 文件系统已挂载到 $SCRIPT_DIR/../mount_point"
\ No newline at end of file
@@ -15,7 +15,16 @@ if [ ${FS_RESULT} -ne 0 ]; then
     exit ${FS_RESULT}
 fi
 
-# 2. 运行性能测试
+# 2. 运行快照镜像测试
+echo "----- 运行快照镜像测试 -----"
+bash "${SCRIPT_DIR}/test_snapshot.sh"
+SNAPSHOT_RESULT=$?
+if [ ${SNAPSHOT_RESULT} -ne 0 ]; then
+    echo "快照镜像测试失败，退出测试流程"
+    exit ${SNAPSHOT_RESULT}
+fi
+
+# 3. 运行性能测试
 echo "----- 运行性能测试 -----"
 bash "${SCRIPT_DIR}/test_performance.sh"
 PERF_RESULT=$?
@@ -24,7 +33,7 @@ if [ ${PERF_RESULT} -ne 0 ]; then
     exit ${PERF_RESULT}
 fi
 
-# 3. 运行压力测试
+# 4. 运行压力测试
 echo "----- 运行压力测试 -----"
 bash "${SCRIPT_DIR}/test_stress.sh"
 STRESS_RESULT=$?
@@ -9,6 +9,9 @@ echo "1. 创建测试目录"
 mkdir -p "${SCRIPT_DIR}/../mount_point"
 mkdir -p "${SCRIPT_DIR}/../target_dir"
 mkdir -p "${SCRIPT_DIR}/../native_dir"
+# 挂载前就在 target 中的目录, 测试在列出它之前重命名
+mkdir -p "${SCRIPT_DIR}/../target_dir/unlisted_dir"
+echo "target 中预先放好的文件" > "${SCRIPT_DIR}/../target_dir/unlisted_dir/file.txt"
 
 # 2. 编译项目
 echo "2. 编译项目"
@@ -0,0 +1,94 @@
+#!/bin/bash
+# test_snapshot.sh - memory_fs 快照镜像测试
+# 用 --snapshot 挂载, 卸载时写入镜像; 重新挂载后从镜像恢复; target 在两次挂载之间被修改时退回扫描
+
+SCRIPT_DIR=$(dirname "$(realpath "${BASH_SOURCE[0]}")")
+MOUNT_POINT="${SCRIPT_DIR}/../mount_point"
+TARGET_DIR="${SCRIPT_DIR}/../target_dir"
+IMAGE="${SCRIPT_DIR}/../snapshot.img"
+LOG="${SCRIPT_DIR}/../snapshot.log"
+SNAPSHOT_TEST_RESULT=0
+echo "===== memory_fs 快照镜像测试 ====="
+
+# 检查条件并输出结果, 失败时记下
+check() {
+    if eval "$2"; then
+        echo "✓ $1"
+    else
+        echo "✗ $1"
+        SNAPSHOT_TEST_RESULT=1
+    fi
+}
+
+# 前台运行 memory_fs, 日志写到 LOG, 卸载后日志才完整
+mount_snapshot() {
+    bash "${SCRIPT_DIR}/mount.sh" -f --log_level info --snapshot "${IMAGE}" > "${LOG}" 2>&1
+}
+
+# 1. 创建测试目录
+echo "1. 创建测试目录"
+mkdir -p "${MOUNT_POINT}"
+mkdir -p "${TARGET_DIR}"
+mkdir -p "${SCRIPT_DIR}/../native_dir"
+rm -f "${IMAGE}" "${LOG}"
+
+# 2. 编译项目
+echo "2. 编译项目"
+cd "${SCRIPT_DIR}/../.."
+if [ ! -d "build" ]; then
+    mkdir -p build
+fi
+cd build
+cmake ..
+make -j$(nproc)
+
+# 3. 第一次挂载: 没有镜像, 扫描 target; 运行功能测试(其中 MEMFS_IOC_SNAPSHOT 不会跳过), 卸载时写入镜像
+echo "3. 第一次挂载"
+mount_snapshot
+"${SCRIPT_DIR}/../../build/test_path_utils/test_fs_operations"
+FS_TEST_RESULT=$?
+check "功能测试通过" "[ ${FS_TEST_RESULT} -eq 0 ]"
+echo "快照中的文件" > "${MOUNT_POINT}/snapshot_file.txt"
+mkdir -p "${MOUNT_POINT}/snapshot_dir"
+echo "快照目录中的文件" > "${MOUNT_POINT}/snapshot_dir/nested.txt"
+bash "${SCRIPT_DIR}/unmount.sh"
+check "卸载时写入镜像" "[ -s '${IMAGE}' ]"
+check "回写到 target" "[ \"\$(cat '${TARGET_DIR}/snapshot_file.txt')\" = '快照中的文件' ]"
+
+# 4. 第二次挂载: 从镜像恢复
+echo "4. 第二次挂载"
+mount_snapshot
+check "恢复后文件内容一致" "[ \"\$(cat '${MOUNT_POINT}/snapshot_file.txt')\" = '快照中的文件' ]"
+check "恢复后子目录内容一致" "[ \"\$(cat '${MOUNT_POINT}/snapshot_dir/nested.txt')\" = '快照目录中的文件' ]"
+bash "${SCRIPT_DIR}/unmount.sh"
+grep "restored .* from snapshot" "${LOG}"
+check "日志中有 restored ... from snapshot" "grep -q 'restored .* from snapshot' '${LOG}'"
+
+# 5. 修改 target 后第三次挂载: 镜像过期, 退回扫描
+echo "5. 修改 target 后第三次挂载"
+sleep 1
+echo "卸载后追加的一行" >> "${TARGET_DIR}/snapshot_file.txt"
+mount_snapshot
+check "扫描得到 target 中修改后的内容" \
+    "[ \"\$(tail -n 1 '${MOUNT_POINT}/snapshot_file.txt')\" = '卸载后追加的一行' ]"
+check "扫描得到子目录" "[ \"\$(cat '${MOUNT_POINT}/snapshot_dir/nested.txt')\" = '快照目录中的文件' ]"
+bash "${SCRIPT_DIR}/unmount.sh"
+grep "is stale" "${LOG}"
+check "日志中镜像过期, 退回扫描" "grep -q 'is stale.*scan target' '${LOG}' && ! grep -q 'restored .* from snapshot' '${LOG}'"
+
+# 6. 清理环境
+echo "6. 清理环境"
+rm -rf "${MOUNT_POINT}"
+rm -rf "${TARGET_DIR}"
+rm -rf "${SCRIPT_DIR}/../native_dir"
+rm -f "${IMAGE}" "${LOG}"
+
+# 7. 输出测试结果
+echo "===== 测试结果 ====="
+if [ ${SNAPSHOT_TEST_RESULT} -ne 0 ]; then
+    echo "快照镜像测试: 失败"
+else
+    echo "快照镜像测试: 通过"
+fi
+
+exit ${SNAPSHOT_TEST_RESULT}
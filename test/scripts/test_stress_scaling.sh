@@ -0,0 +1,36 @@
+#!/bin/bash
+# test_stress_scaling.sh - 不同 FUSE 工作线程数下 test_stress 的吞吐量
+
+SCRIPT_DIR=$(dirname "$(realpath "${BASH_SOURCE[0]}")")
+WORKER_COUNTS="1 2 4 8 16 32"
+CLIENT_THREADS=32
+CLIENT_OPERATIONS=1000
+echo "===== memory_fs 工作线程扩展性测试 ====="
+
+# 1. 编译项目
+echo "1. 编译项目"
+cd "${SCRIPT_DIR}/../.."
+mkdir -p build
+cd build
+cmake ..
+make -j$(nproc)
+
+# 2. 每种配置挂载一次并运行压力测试
+echo "2. 运行测试"
+RESULTS=""
+for clone_fd in false true; do
+    for workers in ${WORKER_COUNTS}; do
+        bash "${SCRIPT_DIR}/mount.sh" --max_threads "${workers}" --max_idle_threads "${workers}" --clone_fd "${clone_fd}"
+        OPS=$("${SCRIPT_DIR}/../../build/test_path_utils/test_stress" ${CLIENT_THREADS} ${CLIENT_OPERATIONS} | grep "每秒操作数" | awk -F': ' '{print $2}')
+        bash "${SCRIPT_DIR}/unmount.sh"
+        rm -rf "${SCRIPT_DIR}/../target_dir"
+        RESULTS="${RESULTS}clone_fd=${clone_fd} 工作线程=${workers}: ${OPS} 次/秒\n"
+    done
+done
+
+# 3. 清理环境
+rm -rf "${SCRIPT_DIR}/../mount_point"
+
+# 4. 输出测试结果
+echo "===== 测试结果 (客户端 ${CLIENT_THREADS} 线程, 每线程 ${CLIENT_OPERATIONS} 次操作) ====="
+echo -e "${RESULTS}"
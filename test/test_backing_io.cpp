@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <filesystem>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../src/io_ring.h"
+
+// 对比回写(flush)和加载(load)本地目录时阻塞 I/O 与 io_uring 批量提交的吞吐量
+// 用法: test_backing_io [目录] [文件数] [每个文件 KB] [队列深度]
+// 加载测试读的是刚写入的文件, 想测冷数据请在两次测试之间 echo 3 > /proc/sys/vm/drop_caches
+
+namespace fs = std::filesystem;
+using namespace std::chrono;
+
+const size_t BLOCK_SIZE = 64 * 1024;
+
+struct BenchConfig {
+    std::string dir = fs::absolute("test/native_dir/backing_io").string();
+    int num_files = 2000;
+    size_t file_size = 256 * 1024;
+    unsigned int depth = 64;
+};
+
+double calculate_throughput(size_t total_bytes, double seconds) {
+    return (total_bytes / (1024.0 * 1024.0)) / seconds; // 转换为 MB/s
+}
+
+std::string file_path(const BenchConfig& config, int i) {
+    return config.dir + "/file_" + std::to_string(i) + ".bin";
+}
+
+// 每个文件切成 64KB 的 iovec, 与 memfs 数据块大小一致
+std::vector<struct iovec> make_iov(char* base, size_t size) {
+    std::vector<struct iovec> iov;
+    for (size_t off = 0; off < size; off += BLOCK_SIZE) {
+        iov.push_back({base + off, std::min(BLOCK_SIZE, size - off)});
+    }
+    return iov;
+}
+
+void report(const char* name, const BenchConfig& config, double seconds) {
+    size_t total = config.num_files * config.file_size;
+    std::cout << name << ": " << seconds << " 秒, " << calculate_throughput(total, seconds) << " MB/s, "
+              << config.num_files / seconds << " 文件/秒" << std::endl;
+}
+
+// 运行一步并输出耗时, 失败的步骤不输出耗时
+bool run_step(const char* name, const BenchConfig& config, const std::function<bool()>& step) {
+    auto start = high_resolution_clock::now();
+    if (!step()) {
+        std::cerr << name << " 失败" << std::endl;
+        return false;
+    }
+    report(name, config, duration<double>(high_resolution_clock::now() - start).count());
+    return true;
+}
+
+bool flush_blocking(const BenchConfig& config, std::vector<char>& data) {
+    std::vector<struct iovec> iov = make_iov(data.data(), config.file_size);
+    for (int i = 0; i < config.num_files; i++) {
+        int fd = open(file_path(config, i).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        bool ok = pwritev(fd, iov.data(), iov.size(), 0) == static_cast<ssize_t>(config.file_size) && fsync(fd) == 0;
+        close(fd);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ring 出错后已提交的 close 不一定会执行, 这时直接 close
+void close_fds(IoRing& ring, const std::vector<int>& fds, bool& ok) {
+    bool use_ring = ring.ready();
+    for (int fd : fds) {
+        if (fd < 0) {
+            continue;
+        }
+        if (use_ring) {
+            ring.close(fd, nullptr);
+        } else {
+            close(fd);
+        }
+    }
+    if (use_ring && ring.wait_all() != 0) {
+        ok = false;
+    }
+}
+
+// 每批最多 depth 个文件, 同时打开的文件数不超过队列深度; 每批的 fd 在批内关闭, 返回前所有请求都已完成
+bool flush_ring(const BenchConfig& config, IoRing& ring, std::vector<char>& data) {
+    std::vector<struct iovec> iov = make_iov(data.data(), config.file_size);
+    bool ok = true;
+    auto check = [&ok](int32_t res) {
+        if (res < 0) {
+            ok = false;
+        }
+    };
+    for (int first = 0; ok && first < config.num_files; first += config.depth) {
+        int n = std::min<int>(config.depth, config.num_files - first);
+        std::vector<std::string> paths;
+        for (int i = 0; i < n; i++) {
+            paths.push_back(file_path(config, first + i));
+        }
+        std::vector<int> fds(n, -1);
+        for (int i = 0; i < n; i++) {
+            ring.openat(AT_FDCWD, paths[i].c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644,
+                        [&fds, i](int32_t res) { fds[i] = res; });
+        }
+        ok = ring.wait_all() == 0 && std::all_of(fds.begin(), fds.end(), [](int fd) { return fd >= 0; });
+        if (ok) {
+            for (int i = 0; i < n; i++) {
+                ring.writev(fds[i], iov.data(), iov.size(), 0, check);
+            }
+            ok = ring.wait_all() == 0 && ok;
+        }
+        if (ok) {
+            for (int i = 0; i < n; i++) {
+                ring.fsync(fds[i], false, check);
+            }
+            ok = ring.wait_all() == 0 && ok;
+        }
+        close_fds(ring, fds, ok);
+    }
+    return ok;
+}
+
+bool load_blocking(const BenchConfig& config, std::vector<char>& buffer) {
+    for (int i = 0; i < config.num_files; i++) {
+        int fd = open(file_path(config, i).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        std::vector<struct iovec> iov = make_iov(buffer.data() + i * config.file_size, config.file_size);
+        bool ok = fstat(fd, &st) == 0 && preadv(fd, iov.data(), iov.size(), 0) == st.st_size;
+        close(fd);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool load_ring(const BenchConfig& config, IoRing& ring, std::vector<char>& buffer) {
+    bool ok = true;
+    size_t expected = config.file_size;
+    for (int first = 0; ok && first < config.num_files; first += config.depth) {
+        int n = std::min<int>(config.depth, config.num_files - first);
+        std::vector<std::string> paths;
+        std::vector<std::vector<struct iovec>> iovs;
+        for (int i = 0; i < n; i++) {
+            paths.push_back(file_path(config, first + i));
+            iovs.push_back(make_iov(buffer.data() + (first + i) * config.file_size, config.file_size));
+        }
+        std::vector<int> fds(n, -1);
+        for (int i = 0; i < n; i++) {
+            ring.openat(AT_FDCWD, paths[i].c_str(), O_RDONLY | O_CLOEXEC, 0, [&fds, i](int32_t res) { fds[i] = res; });
+        }
+        ok = ring.wait_all() == 0 && std::all_of(fds.begin(), fds.end(), [](int fd) { return fd >= 0; });
+        if (ok) {
+            for (int i = 0; i < n; i++) {
+                ring.readv(fds[i], iovs[i].data(), iovs[i].size(), 0, [&ok, expected](int32_t res) {
+                    if (res < 0 || static_cast<size_t>(res) != expected) {
+                        ok = false;
+                    }
+                });
+            }
+            ok = ring.wait_all() == 0 && ok;
+        }
+        close_fds(ring, fds, ok);
+    }
+    return ok;
+}
+
+bool verify(const BenchConfig& config, const std::vector<char>& data, const std::vector<char>& buffer) {
+    for (int i = 0; i < config.num_files; i++) {
+        if (memcmp(buffer.data() + i * config.file_size, data.data(), config.file_size) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    if (argc > 1) {
+        config.dir = fs::absolute(argv[1]).string();
+    }
+    if (argc > 2) {
+        config.num_files = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        config.file_size = atoi(argv[3]) * 1024;
+    }
+    if (argc > 4) {
+        config.depth = atoi(argv[4]);
+    }
+    fs::create_directories(config.dir);
+    std::cout << "目录 " << config.dir << ", " << config.num_files << " 个文件, 每个 " << config.file_size / 1024
+              << "KB, 队列深度 " << config.depth << std::endl;
+
+    std::vector<char> data(config.file_size);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<char>(i * 131 + 7);
+    }
+    std::vector<char> buffer(config.num_files * config.file_size);
+
+    IoRing ring;
+    int ret = ring.init(config.depth);
+    if (ret != 0) {
+        std::cout << "io_uring 不可用(" << strerror(-ret) << "), 只测试阻塞 I/O" << std::endl;
+    }
+
+    bool ok = run_step("回写 阻塞 I/O", config, [&] { return flush_blocking(config, data); });
+    ok = ok && run_step("加载 阻塞 I/O", config, [&] { return load_blocking(config, buffer); });
+    ok = ok && verify(config, data, buffer);
+
+    if (ok && ring.ready()) {
+        memset(buffer.data(), 0, buffer.size());
+        ok = run_step("回写 io_uring", config, [&] { return flush_ring(config, ring, data); });
+        ok = ok && run_step("加载 io_uring", config, [&] { return load_ring(config, ring, buffer); });
+        ok = ok && verify(config, data, buffer);
+    }
+
+    std::error_code ec;
+    fs::remove_all(config.dir, ec);
+    if (!ok) {
+        std::cerr << "读写或数据校验失败" << std::endl;
+        return 1;
+    }
+    return 0;
+}
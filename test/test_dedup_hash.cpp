@@ -0,0 +1,87 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+
+#include "../src/chunk_store.h"
+#include "../src/file_data.h"
+#include "../src/slab_allocator.h"
+
+// 估算 --dedup true 在写路径上增加的开销: 每写满一个 64KB 块要算一次哈希并查表(命中时再比较一次内容)
+// 对比同样大小的 memcpy(写入本身的拷贝开销), 分别测不重复的块和全部重复的块
+// 用法: test_dedup_hash [块数]
+
+using namespace std::chrono;
+
+const size_t CHUNK = FileData::CHUNK_SIZE;
+
+void report(const char* name, size_t chunks, double seconds) {
+    std::cout << name << ": 每块 " << seconds * 1e9 / chunks << " ns, "
+              << chunks * CHUNK / (1024.0 * 1024.0) / seconds << " MB/s" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t chunks = 4096;
+    if (argc > 1) {
+        chunks = atoi(argv[1]);
+    }
+    std::cout << chunks << " 个 " << CHUNK / 1024 << "KB 的块" << std::endl;
+
+    std::vector<char> data(chunks * CHUNK);
+    for (size_t i = 0; i < data.size(); i += 8) {
+        uint64_t v = i * 0x9E3779B97F4A7C15ULL;
+        memcpy(&data[i], &v, 8);
+    }
+    std::vector<char> dst(CHUNK);
+
+    auto start = high_resolution_clock::now();
+    for (size_t i = 0; i < chunks; i++) {
+        memcpy(dst.data(), &data[i * CHUNK], CHUNK);
+    }
+    report("memcpy", chunks, duration<double>(high_resolution_clock::now() - start).count());
+
+    uint64_t sum = 0;
+    start = high_resolution_clock::now();
+    for (size_t i = 0; i < chunks; i++) {
+        sum += hash_chunk(&data[i * CHUNK], CHUNK);
+    }
+    report("哈希", chunks, duration<double>(high_resolution_clock::now() - start).count());
+
+    // 登记不重复的块: 哈希 + 插入新表项
+    ChunkStore& store = ChunkStore::instance();
+    std::vector<SharedChunk*> shared;
+    start = high_resolution_clock::now();
+    for (size_t i = 0; i < chunks; i++) {
+        char* chunk = static_cast<char*>(slab_alloc(CHUNK));
+        memcpy(chunk, &data[i * CHUNK], CHUNK);
+        shared.push_back(store.intern(chunk));
+    }
+    report("memcpy + 登记不重复的块", chunks, duration<double>(high_resolution_clock::now() - start).count());
+
+    // 登记重复的块: 哈希 + 命中后比较内容, 释放自己的副本
+    char* copy = static_cast<char*>(slab_alloc(CHUNK));
+    start = high_resolution_clock::now();
+    for (size_t i = 0; i < chunks; i++) {
+        memcpy(copy, &data[i * CHUNK], CHUNK);
+        shared.push_back(store.intern(copy));
+    }
+    report("memcpy + 登记重复的块", chunks, duration<double>(high_resolution_clock::now() - start).count());
+    slab_free(copy, CHUNK);
+
+    ChunkStore::Stats stats = store.stats();
+    bool ok = stats.chunks == chunks && stats.refs == chunks * 2;
+    for (SharedChunk* chunk : shared) {
+        ok = ok && chunk != nullptr;
+        if (chunk != nullptr) {
+            store.release(chunk);
+        }
+    }
+    ok = ok && store.stats().chunks == 0;
+    std::cout << "(校验和 " << (sum & 0xffff) << ")" << std::endl;
+    if (!ok) {
+        std::cerr << "去重表统计不符" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -7,6 +7,10 @@
 #include <vector>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+
+#include "../src/mem_fs_ioctl.h"
 
 namespace fs = std::filesystem;
 
@@ -219,6 +223,39 @@ bool test_rename_operations()
 	}
 }
 
+// 测试重命名还没列出过的 target 子目录: 脚本在挂载前放好 unlisted_dir/file.txt
+bool test_rename_unlisted_dir()
+{
+	std::cout << "=== 测试重命名未加载的目录 ===" << std::endl;
+
+	std::string src_dir = MOUNT_POINT + "/unlisted_dir";
+	std::string dst_dir = MOUNT_POINT + "/unlisted_dir_moved";
+	if (!fs::exists(TARGET_DIR + "/unlisted_dir/file.txt")) {
+		std::cout << "- target 中没有预先放好的 unlisted_dir, 跳过" << std::endl;
+		return true;
+	}
+	try {
+		// 重命名前不能列出或访问目录内容
+		fs::rename(src_dir, dst_dir);
+		std::vector<std::string> names;
+		for (const auto& entry : fs::directory_iterator(dst_dir)) {
+			names.push_back(entry.path().filename().string());
+		}
+		bool ok = names.size() == 1 && names[0] == "file.txt"
+				  && verify_file_content(dst_dir + "/file.txt", "target 中预先放好的文件\n");
+		fs::rename(dst_dir, src_dir);
+		if (!ok) {
+			std::cerr << "重命名后目录内容丢失, 列出 " << names.size() << " 项" << std::endl;
+			return false;
+		}
+		std::cout << "✓ 重命名后目录内容完整" << std::endl;
+	} catch (const std::exception& e) {
+		std::cerr << "重命名未加载的目录失败: " << e.what() << std::endl;
+		return false;
+	}
+	return true;
+}
+
 // 测试大文件操作
 bool test_large_file_operations()
 {
@@ -320,6 +357,229 @@ bool test_truncate()
 	return true;
 }
 
+bool test_sparse_file()
+{
+	std::cout << "=== 测试稀疏文件 ===" << std::endl;
+
+	std::string test_file = MOUNT_POINT + "/sparse_file.bin";
+	FileGuard guard(test_file);
+	int fd = open(test_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		std::cerr << "无法创建稀疏文件: " << test_file << std::endl;
+		return false;
+	}
+
+	// 在 10GB 处写入少量数据, 前面全是空洞
+	const off_t data_offset = 10LL * 1024 * 1024 * 1024;
+	const std::string content = "sparse";
+	bool ok = pwrite(fd, content.data(), content.size(), data_offset) == static_cast<ssize_t>(content.size());
+	struct stat st;
+	ok = ok && fstat(fd, &st) == 0 && st.st_size == data_offset + static_cast<off_t>(content.size());
+	if (!ok || st.st_blocks * 512 > 1024 * 1024) {
+		std::cerr << "稀疏文件大小或占用空间验证失败" << std::endl;
+		close(fd);
+		return false;
+	}
+	std::cout << "✓ 空洞不占用内存" << std::endl;
+
+	char buf[4096];
+	memset(buf, 1, sizeof(buf));
+	ok = pread(fd, buf, sizeof(buf), data_offset / 2) == sizeof(buf);
+	for (size_t i = 0; ok && i < sizeof(buf); i++) {
+		ok = buf[i] == 0;
+	}
+	if (!ok) {
+		std::cerr << "空洞读取内容不为零" << std::endl;
+		close(fd);
+		return false;
+	}
+	std::cout << "✓ 空洞读出全零" << std::endl;
+
+	off_t hole = lseek(fd, 0, SEEK_HOLE);
+	off_t data = lseek(fd, 0, SEEK_DATA);
+	off_t end_hole = lseek(fd, data_offset, SEEK_HOLE);
+	close(fd);
+	if (hole != 0 || data > data_offset || data < data_offset - 1024 * 1024 || end_hole != st.st_size) {
+		std::cerr << "SEEK_HOLE/SEEK_DATA 验证失败: hole=" << hole << " data=" << data << " end_hole=" << end_hole
+				  << std::endl;
+		return false;
+	}
+	std::cout << "✓ SEEK_HOLE/SEEK_DATA 跳过空洞" << std::endl;
+	return true;
+}
+
+bool test_fsync()
+{
+	std::cout << "=== 测试 fsync 回写 ===" << std::endl;
+
+	// 子目录只在内存中创建过, fsync 时要在 target 中补建
+	std::string sub_dir = MOUNT_POINT + "/fsync_dir";
+	std::string test_file = sub_dir + "/fsync_file.txt";
+	std::string target_file = TARGET_DIR + "/fsync_dir/fsync_file.txt";
+	std::string content = "需要落盘的数据";
+	fs::create_directory(sub_dir);
+	int fd = open(test_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		std::cerr << "无法创建文件: " << test_file << std::endl;
+		return false;
+	}
+	bool ok = write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size()) && fsync(fd) == 0;
+	close(fd);
+	if (!ok || !verify_file_content(target_file, content)) {
+		std::cerr << "fsync 后 target 目录中的文件内容不一致" << std::endl;
+		fs::remove_all(sub_dir);
+		fs::remove_all(TARGET_DIR + "/fsync_dir");
+		return false;
+	}
+	std::cout << "✓ fsync 后数据已写回 target 目录" << std::endl;
+
+	fd = open(test_file.c_str(), O_RDWR);
+	ok = fd >= 0 && ftruncate(fd, 3) == 0 && fdatasync(fd) == 0;
+	if (fd >= 0) {
+		close(fd);
+	}
+	ok = ok && fs::file_size(target_file) == 3;
+	// 删除不会同步到 target 目录, 两边都要清理
+	fs::remove_all(sub_dir);
+	fs::remove_all(TARGET_DIR + "/fsync_dir");
+	if (!ok) {
+		std::cerr << "fdatasync 后 target 目录中的文件大小不一致" << std::endl;
+		return false;
+	}
+	std::cout << "✓ fdatasync 后截断已写回 target 目录" << std::endl;
+	return true;
+}
+
+bool test_copy_file_range()
+{
+	std::cout << "=== 测试 copy_file_range 和克隆 ===" << std::endl;
+
+	std::string src_file = MOUNT_POINT + "/clone_src.bin";
+	std::string dst_file = MOUNT_POINT + "/clone_dst.bin";
+	std::string ioctl_file = MOUNT_POINT + "/clone_ioctl.bin";
+	FileGuard src_guard(src_file);
+	FileGuard dst_guard(dst_file);
+	FileGuard ioctl_guard(ioctl_file);
+	std::string content(1024 * 1024 + 123, '\0');
+	for (size_t i = 0; i < content.size(); i++) {
+		content[i] = static_cast<char>(i * 131 + 7);
+	}
+	create_test_file(src_file, content);
+
+	int src = open(src_file.c_str(), O_RDONLY);
+	int dst = open(dst_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	bool ok = src >= 0 && dst >= 0;
+	size_t copied = 0;
+	while (ok && copied < content.size()) {
+		ssize_t n = copy_file_range(src, nullptr, dst, nullptr, content.size() - copied, 0);
+		ok = n > 0;
+		copied += ok ? n : 0;
+	}
+	// 修改副本不影响源文件
+	ok = ok && pwrite(dst, "copy", 4, 100000) == 4;
+	if (src >= 0) {
+		close(src);
+	}
+	if (dst >= 0) {
+		close(dst);
+	}
+	std::string modified = content;
+	modified.replace(100000, 4, "copy");
+	if (!ok || !verify_file_content(dst_file, modified) || !verify_file_content(src_file, content)) {
+		std::cerr << "copy_file_range 后内容不一致" << std::endl;
+		return false;
+	}
+	std::cout << "✓ copy_file_range 复制的文件写入后与源文件分离" << std::endl;
+
+	int fd = open(ioctl_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	struct memfs_clone_range range = {};
+	range.src_length = 0;
+	strcpy(range.src_path, "/clone_src.bin");
+	ok = fd >= 0 && ioctl(fd, MEMFS_IOC_CLONE_RANGE, &range) == 0;
+	if (fd >= 0) {
+		close(fd);
+	}
+	if (!ok || !verify_file_content(ioctl_file, content)) {
+		std::cerr << "MEMFS_IOC_CLONE_RANGE 克隆失败" << std::endl;
+		return false;
+	}
+	std::cout << "✓ MEMFS_IOC_CLONE_RANGE 克隆整个文件" << std::endl;
+	return true;
+}
+
+bool test_fallocate()
+{
+	std::cout << "=== 测试 fallocate ===" << std::endl;
+
+	std::string test_file = MOUNT_POINT + "/fallocate_file.bin";
+	FileGuard guard(test_file);
+	int fd = open(test_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		std::cerr << "无法创建文件: " << test_file << std::endl;
+		return false;
+	}
+
+	// 预分配 4MB: 大小增加, 内存立即分配
+	const off_t size = 4 * 1024 * 1024;
+	struct stat st;
+	bool ok = fallocate(fd, 0, 0, size) == 0 && fstat(fd, &st) == 0 && st.st_size == size
+			  && st.st_blocks * 512 >= size;
+	// KEEP_SIZE 预分配文件末尾之后的空间, 大小不变
+	ok = ok && fallocate(fd, FALLOC_FL_KEEP_SIZE, size, size) == 0 && fstat(fd, &st) == 0 && st.st_size == size
+		 && st.st_blocks * 512 >= 2 * size;
+	if (!ok) {
+		std::cerr << "fallocate 预分配验证失败" << std::endl;
+		close(fd);
+		return false;
+	}
+	std::cout << "✓ fallocate 预分配, KEEP_SIZE 不改变大小" << std::endl;
+
+	std::string content(size, 'x');
+	ok = pwrite(fd, content.data(), content.size(), 0) == size;
+	// 打洞释放中间 1MB 的内存, 读出全零
+	ok = ok && fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 1024 * 1024, 1024 * 1024 + 100) == 0;
+	struct stat punched;
+	ok = ok && fstat(fd, &punched) == 0 && punched.st_size == size && punched.st_blocks < st.st_blocks;
+	content.replace(1024 * 1024, 1024 * 1024 + 100, 1024 * 1024 + 100, '\0');
+	// ZERO_RANGE 跨过文件末尾时扩大文件
+	ok = ok && fallocate(fd, FALLOC_FL_ZERO_RANGE, size - 10, 20) == 0;
+	content.replace(size - 10, 10, 20, '\0');
+	close(fd);
+	if (!ok || !verify_file_content(test_file, content)) {
+		std::cerr << "PUNCH_HOLE/ZERO_RANGE 验证失败" << std::endl;
+		return false;
+	}
+	std::cout << "✓ PUNCH_HOLE 释放内存, ZERO_RANGE 清零" << std::endl;
+	return true;
+}
+
+bool test_snapshot()
+{
+	std::cout << "=== 测试快照镜像 ===" << std::endl;
+
+	std::string test_file = MOUNT_POINT + "/snapshot_file.txt";
+	FileGuard guard(test_file);
+	create_test_file(test_file, "快照中的文件");
+	int fd = open(test_file.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cerr << "无法打开文件: " << test_file << std::endl;
+		return false;
+	}
+	int ret = ioctl(fd, MEMFS_IOC_SNAPSHOT);
+	int err = errno;
+	close(fd);
+	if (ret != 0 && err == EINVAL) {
+		std::cout << "- 挂载时没有指定 --snapshot, 跳过" << std::endl;
+		return true;
+	}
+	if (ret != 0) {
+		std::cerr << "MEMFS_IOC_SNAPSHOT 失败: " << strerror(err) << std::endl;
+		return false;
+	}
+	std::cout << "✓ MEMFS_IOC_SNAPSHOT 写入镜像" << std::endl;
+	return true;
+}
+
 // 主函数
 int main()
 {
@@ -331,8 +591,14 @@ int main()
 	all_tests_passed &= test_basic_file_operations();
 	all_tests_passed &= test_directory_operations();
 	all_tests_passed &= test_rename_operations();
+	all_tests_passed &= test_rename_unlisted_dir();
 	all_tests_passed &= test_large_file_operations();
 	all_tests_passed &= test_truncate();
+	all_tests_passed &= test_sparse_file();
+	all_tests_passed &= test_fsync();
+	all_tests_passed &= test_copy_file_range();
+	all_tests_passed &= test_fallocate();
+	all_tests_passed &= test_snapshot();
 
 	if (all_tests_passed) {
 		std::cout << "\n所有测试通过！" << std::endl;
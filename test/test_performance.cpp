@@ -5,6 +5,11 @@
 #include <chrono>
 #include <vector>
 #include <random>
+#include <thread>
+#include <cstring>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 using namespace std::chrono;
@@ -20,6 +25,13 @@ const int NUM_FILES_SMALL = FILE_TOTAL_SIZE / FILE_SIZE_SMALL;
 const int NUM_FILES_MEDIUM = FILE_TOTAL_SIZE / FILE_SIZE_MEDIUM;
 const int NUM_FILES_LARGE = FILE_TOTAL_SIZE / FILE_SIZE_LARGE;
 const int NUM_ITERATIONS = 5;
+const int SCALING_MAX_THREADS = 64;
+const int SCALING_FILES_PER_THREAD = 2000;
+const int RENAME_TREE_SIZES[] = {10000, 100000, 1000000};
+const int RENAME_ITERATIONS = 100;
+const int STAT_NUM_FILES = 10000;
+const int STAT_ROUNDS = 20;
+const size_t SEQUENTIAL_BLOCK_SIZE = 1024 * 1024; // 1MB
 
 double calculate_throughput(size_t total_bytes, double seconds) {
     return (total_bytes / (1024.0 * 1024.0)) / seconds; // 转换为 MB/s
@@ -109,6 +121,196 @@ double test_rmdir_performance(const std::string& dir, int num_dirs) {
     return duration_cast<milliseconds>(end - start).count() / 1000.0;
 }
 
+// 多线程在各自的目录下并发创建文件
+double test_create_scaling(const std::string& dir, int num_threads, int files_per_thread) {
+    for (int t = 0; t < num_threads; t++) {
+        fs::create_directories(dir + "/scaling_" + std::to_string(t));
+    }
+
+    auto start = high_resolution_clock::now();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&dir, t, files_per_thread]() {
+            std::string thread_dir = dir + "/scaling_" + std::to_string(t);
+            for (int i = 0; i < files_per_thread; i++) {
+                std::ofstream file(thread_dir + "/file_" + std::to_string(i));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto end = high_resolution_clock::now();
+
+    for (int t = 0; t < num_threads; t++) {
+        fs::remove_all(dir + "/scaling_" + std::to_string(t));
+    }
+    return duration_cast<microseconds>(end - start).count() / 1000000.0;
+}
+
+// 并发创建文件的扩展性测试: 1 到 64 线程
+void run_scaling_tests() {
+    std::cout << "=== 并发创建扩展性测试开始 ===" << std::endl;
+
+    fs::create_directories(MOUNT_POINT);
+    fs::create_directories(NATIVE_DIR);
+
+    double memfs_base = 0;
+    for (int threads = 1; threads <= SCALING_MAX_THREADS; threads *= 2) {
+        double memfs_time = test_create_scaling(MOUNT_POINT, threads, SCALING_FILES_PER_THREAD);
+        double native_time = test_create_scaling(NATIVE_DIR, threads, SCALING_FILES_PER_THREAD);
+        double memfs_ops = threads * SCALING_FILES_PER_THREAD / memfs_time;
+        double native_ops = threads * SCALING_FILES_PER_THREAD / native_time;
+        if (threads == 1) {
+            memfs_base = memfs_ops;
+        }
+        std::cout << threads << " 线程:" << std::endl;
+        std::cout << "  Memory FS: " << memfs_ops << " 次创建/秒, 相对单线程 " << (memfs_ops / memfs_base) << "x" << std::endl;
+        std::cout << "  本地文件系统: " << native_ops << " 次创建/秒" << std::endl;
+    }
+
+    std::cout << "=== 并发创建扩展性测试完成 ===" << std::endl;
+}
+
+// 创建包含 num_entries 个文件的目录, 每个子目录最多放 10000 个
+void create_tree(const std::string& dir, int num_entries) {
+    fs::create_directories(dir);
+    for (int i = 0; i < num_entries; i++) {
+        std::string sub_dir = dir + "/sub_" + std::to_string(i / 10000);
+        if (i % 10000 == 0) {
+            fs::create_directories(sub_dir);
+        }
+        std::ofstream file(sub_dir + "/file_" + std::to_string(i));
+    }
+}
+
+// 来回重命名目录, 返回单次重命名的平均耗时(微秒)
+double test_rename_dir_performance(const std::string& dir, int iterations) {
+    std::string src = dir + "/rename_src";
+    std::string dst = dir + "/rename_dst";
+    auto start = high_resolution_clock::now();
+
+    for (int i = 0; i < iterations; i++) {
+        fs::rename(src, dst);
+        fs::rename(dst, src);
+    }
+
+    auto end = high_resolution_clock::now();
+    return duration_cast<microseconds>(end - start).count() / (iterations * 2.0);
+}
+
+// 目录重命名耗时与子树大小的关系
+void run_rename_tests() {
+    std::cout << "=== 目录重命名测试开始 ===" << std::endl;
+
+    for (int num_entries : RENAME_TREE_SIZES) {
+        create_tree(MOUNT_POINT + "/rename_src", num_entries);
+        create_tree(NATIVE_DIR + "/rename_src", num_entries);
+
+        double memfs_time = test_rename_dir_performance(MOUNT_POINT, RENAME_ITERATIONS);
+        double native_time = test_rename_dir_performance(NATIVE_DIR, RENAME_ITERATIONS);
+
+        std::cout << "重命名包含 " << num_entries << " 个文件的目录:" << std::endl;
+        std::cout << "  Memory FS: " << memfs_time << " 微秒/次" << std::endl;
+        std::cout << "  本地文件系统: " << native_time << " 微秒/次" << std::endl;
+
+        fs::remove_all(MOUNT_POINT + "/rename_src");
+        fs::remove_all(NATIVE_DIR + "/rename_src");
+    }
+
+    std::cout << "=== 目录重命名测试完成 ===" << std::endl;
+}
+
+// 反复 stat 已存在和不存在的文件, 返回每秒 stat 次数
+double test_stat_performance(const std::string& dir, int num_files, int rounds) {
+    struct stat st;
+    auto start = high_resolution_clock::now();
+
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < num_files; i++) {
+            std::string sub_dir = dir + "/stat_tree/sub_" + std::to_string(i / 10000);
+            stat((sub_dir + "/file_" + std::to_string(i)).c_str(), &st);
+            stat((sub_dir + "/missing_" + std::to_string(i)).c_str(), &st);
+        }
+    }
+
+    auto end = high_resolution_clock::now();
+    return num_files * rounds * 2 / (duration_cast<microseconds>(end - start).count() / 1000000.0);
+}
+
+// stat 密集负载, 内核缓存生效时大部分 stat 不会到达 memfs
+// memfs 退出时日志中的 requests 一行给出实际收到的 lookup/getattr 次数
+void run_stat_tests() {
+    std::cout << "=== stat 测试开始 ===" << std::endl;
+
+    create_tree(MOUNT_POINT + "/stat_tree", STAT_NUM_FILES);
+    create_tree(NATIVE_DIR + "/stat_tree", STAT_NUM_FILES);
+
+    double memfs_ops = test_stat_performance(MOUNT_POINT, STAT_NUM_FILES, STAT_ROUNDS);
+    double native_ops = test_stat_performance(NATIVE_DIR, STAT_NUM_FILES, STAT_ROUNDS);
+
+    std::cout << STAT_NUM_FILES << " 个文件, " << STAT_ROUNDS << " 轮 stat (一半目标不存在):" << std::endl;
+    std::cout << "  Memory FS: " << memfs_ops << " 次/秒" << std::endl;
+    std::cout << "  本地文件系统: " << native_ops << " 次/秒" << std::endl;
+
+    fs::remove_all(MOUNT_POINT + "/stat_tree");
+    fs::remove_all(NATIVE_DIR + "/stat_tree");
+
+    std::cout << "=== stat 测试完成 ===" << std::endl;
+}
+
+// 以 1MB 为单位顺序写入 1GB 文件, 返回耗时(秒)
+double test_sequential_write(const std::string& file_path, const std::vector<char>& block) {
+    auto start = high_resolution_clock::now();
+
+    int fd = open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    for (size_t written = 0; written < FILE_TOTAL_SIZE; written += block.size()) {
+        if (write(fd, block.data(), block.size()) != static_cast<ssize_t>(block.size())) {
+            std::cerr << "写入失败: " << file_path << std::endl;
+            break;
+        }
+    }
+    close(fd);
+
+    auto end = high_resolution_clock::now();
+    return duration_cast<microseconds>(end - start).count() / 1000000.0;
+}
+
+// 以 1MB 为单位顺序读取整个文件, 返回耗时(秒)
+double test_sequential_read(const std::string& file_path, size_t block_size) {
+    std::vector<char> buffer(block_size);
+    auto start = high_resolution_clock::now();
+
+    int fd = open(file_path.c_str(), O_RDONLY);
+    while (read(fd, buffer.data(), buffer.size()) > 0) {
+    }
+    close(fd);
+
+    auto end = high_resolution_clock::now();
+    return duration_cast<microseconds>(end - start).count() / 1000000.0;
+}
+
+// 1GB 顺序读写吞吐量, 分别用 --splice true 和 false 挂载运行以对比
+void run_sequential_tests() {
+    std::cout << "=== 顺序读写测试开始 ===" << std::endl;
+
+    std::vector<char> block = generate_random_data(SEQUENTIAL_BLOCK_SIZE);
+    for (const std::string& dir : {MOUNT_POINT, NATIVE_DIR}) {
+        fs::create_directories(dir);
+        std::string file_path = dir + "/sequential.bin";
+        double write_time = test_sequential_write(file_path, block);
+        double read_time = test_sequential_read(file_path, SEQUENTIAL_BLOCK_SIZE);
+        std::cout << (dir == MOUNT_POINT ? "Memory FS" : "本地文件系统") << ":" << std::endl;
+        std::cout << "  顺序写入 1GB: " << calculate_throughput(FILE_TOTAL_SIZE, write_time) << " MB/s" << std::endl;
+        std::cout << "  顺序读取 1GB: " << calculate_throughput(FILE_TOTAL_SIZE, read_time) << " MB/s" << std::endl;
+        fs::remove(file_path);
+    }
+
+    std::cout << "=== 顺序读写测试完成 ===" << std::endl;
+}
+
 // 运行所有性能测试
 void run_performance_tests() {
     std::cout << "=== 性能测试开始 ===" << std::endl;
@@ -234,7 +436,31 @@ void run_performance_tests() {
     std::cout << "=== 性能测试完成 ===" << std::endl;
 }
 
-int main() {
-    run_performance_tests();
+// 不带参数时运行全部测试, 否则只运行指定的测试: performance, scaling, rename, stat, sequential
+int main(int argc, char* argv[]) {
+    bool run_all = argc < 2;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "performance") == 0) {
+            run_performance_tests();
+        } else if (strcmp(argv[i], "scaling") == 0) {
+            run_scaling_tests();
+        } else if (strcmp(argv[i], "rename") == 0) {
+            run_rename_tests();
+        } else if (strcmp(argv[i], "stat") == 0) {
+            run_stat_tests();
+        } else if (strcmp(argv[i], "sequential") == 0) {
+            run_sequential_tests();
+        } else {
+            std::cerr << "未知测试: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (run_all) {
+        run_performance_tests();
+        run_scaling_tests();
+        run_rename_tests();
+        run_stat_tests();
+        run_sequential_tests();
+    }
     return 0;
 }
\ No newline at end of file
@@ -14,8 +14,9 @@ namespace fs = std::filesystem;
 
 // 测试配置
 const std::string MOUNT_POINT = "../test/mount_point";
-const int NUM_THREADS = 8;
-const int NUM_OPERATIONS = 100;
+// 可由命令行参数覆盖: test_stress [线程数] [每线程操作数]
+int NUM_THREADS = 8;
+int NUM_OPERATIONS = 100;
 const int MAX_FILE_SIZE = 1024 * 1024; // 1MB
 
 // 线程安全的随机数生成
@@ -292,7 +293,13 @@ void run_stress_test() {
     std::cout << "每秒操作数: " << (total_operations_completed * 1000.0 / duration) << std::endl;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        NUM_THREADS = std::stoi(argv[1]);
+    }
+    if (argc > 2) {
+        NUM_OPERATIONS = std::stoi(argv[2]);
+    }
     run_stress_test();
     return 0;
 }
\ No newline at end of file